@@ -29,8 +29,9 @@ void clip_page_reset()
 
 void clip_page_reset_input_only()
 {
-	clip_page::input_video.reset();
+	// The demuxer restores the streams of the media when it's destroyed, so it goes first.
 	clip_page::demuxer.reset();
+	clip_page::input_video.reset();
 
 	clip_page::is_input_opened = false;
 	
@@ -51,7 +52,14 @@ bool clip_page_open_input_video(const char* file_path)
 {
 	try
 	{
-		clip_page::input_video.reset(new ff::input_media(file_path));
+		// The GUI reopens the same files again and again, so don't probe them more than once.
+		ff::input_options opts;
+		opts.skip_stream_info_if_complete = true;
+		opts.use_probe_cache = true;
+
+		// The old demuxer must not outlive the old media.
+		clip_page::demuxer.reset();
+		clip_page::input_video.reset(new ff::input_media(file_path, opts));
 		clip_page::demuxer.reset(new ff::demuxer(*clip_page::input_video));
 	}
 	catch (const std::runtime_error& err) // failed
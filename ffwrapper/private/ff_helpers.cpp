@@ -9,6 +9,9 @@ extern "C"
 
 #include "ff_helpers.h"
 
+#include <filesystem>
+#include <system_error>
+
 namespace ffhelpers
 {
 	void safely_close_input_format_context(AVFormatContext** ppfc)
@@ -36,6 +39,16 @@ namespace ffhelpers
 		}
 	}
 
+	void safely_free_custom_avio_context(AVIOContext** ppioct)
+	{
+		if (*ppioct)
+		{
+			// The buffer may have been reallocated by ffmpeg, so free the current one.
+			av_freep(&(*ppioct)->buffer);
+			avio_context_free(ppioct);
+		}
+	}
+
 	void safely_free_frame(AVFrame** ppf)
 	{
 		if (*ppf)
@@ -115,4 +128,23 @@ namespace ffhelpers
 		par->profile = FF_PROFILE_UNKNOWN;
 		par->level = FF_LEVEL_UNKNOWN;
 	}
+
+	bool get_file_version(const std::string& fp, uint64_t& size, int64_t& mtime)
+	{
+		std::error_code ec;
+		auto path = std::filesystem::path(fp);
+
+		size = std::filesystem::file_size(path, ec);
+		if (ec)
+		{
+			return false;
+		}
+		auto time = std::filesystem::last_write_time(path, ec);
+		if (ec)
+		{
+			return false;
+		}
+		mtime = (int64_t)time.time_since_epoch().count();
+		return true;
+	}
 }
\ No newline at end of file
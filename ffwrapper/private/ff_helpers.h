@@ -18,6 +18,7 @@ struct AVAudioFifo;
 struct AVCodecParameters;
 
 #include <string>
+#include <cstdint>
 
 namespace ffhelpers
 {
@@ -31,6 +32,9 @@ namespace ffhelpers
 
 	void safely_free_avio_context(::AVIOContext** ppioct);
 
+	// For AVIOContexts made by avio_alloc_context(). Frees their buffer as well.
+	void safely_free_custom_avio_context(::AVIOContext** ppioct);
+
 	void safely_free_frame(::AVFrame** ppf);
 
 	void safely_free_packet(::AVPacket** pppkt);
@@ -52,5 +56,12 @@ namespace ffhelpers
 
 	// Copied from https://ffmpeg.org/doxygen/5.1/codec__par_8c_source.html#l00031
 	void codec_parameters_reset(::AVCodecParameters* par);
+
+	/*
+	* Gets the version of the file at fp, which is its size and its modification time.
+	* Used to tell if what is remembered about a file is still valid.
+	* @returns false if it cannot be read.
+	*/
+	bool get_file_version(const std::string& fp, uint64_t& size, int64_t& mtime);
 }
 
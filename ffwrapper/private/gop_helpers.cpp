@@ -0,0 +1,74 @@
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "gop_helpers.h"
+#include "ff_helpers.h"
+
+#include "../public/frame.h"
+#include "../public/media.h"
+#include "../public/decoder.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace ffhelpers
+{
+	int64_t frame_time(const ff::frame& f)
+	{
+		return f->pts != AV_NOPTS_VALUE ? f->pts : f->best_effort_timestamp;
+	}
+
+	int64_t packet_time(const ff::packet& pkt)
+	{
+		return pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+	}
+
+	int choose_video_stream(const ff::input_media& m, int i)
+	{
+		if (i == -1)
+		{
+			if (!m.has_videos())
+			{
+				ON_FF_ERROR("The media has no video streams to decode.")
+			}
+			return m.get_video_i(0);
+		}
+
+		if (i < 0 || i >= m.num_streams() || !m.get_stream(i).is_video())
+		{
+			ON_FF_ERROR("Only video streams can be decoded by GOPs.")
+		}
+		return i;
+	}
+
+	std::vector<int> all_streams_but(const ff::input_media& m, int i)
+	{
+		std::vector<int> ret;
+		for (int j = 0; j != m.num_streams(); ++j)
+		{
+			if (j != i)
+			{
+				ret.push_back(j);
+			}
+		}
+		return ret;
+	}
+
+	int64_t seek_back_target(int64_t target, int64_t missed_by)
+	{
+		return std::max<int64_t>(target - 2 * std::max<int64_t>(missed_by, 1), 1);
+	}
+
+	void feed_requested_packet(ff::decoder& dec, ff::packet& pkt, const char* what)
+	{
+		ff::status st = dec.feed(pkt);
+		// The decoder only asks for packets after all its frames are out, so it cannot refuse this one.
+		if (!st.ok())
+		{
+			ON_FF_ERROR_WITH_CODE(what, st.code)
+		}
+	}
+}
@@ -0,0 +1,47 @@
+/*
+* gop_helpers.h:
+* Defines PRIVATE helpers shared by the classes that decode a video stream GOP by GOP after seeking (frame_server, gop_parallel_decoder).
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace ff
+{
+	struct frame;
+	struct packet;
+	class decoder;
+	class input_media;
+}
+
+namespace ffhelpers
+{
+	// @returns the time a frame is shown at.
+	int64_t frame_time(const ff::frame& f);
+
+	// @returns the pts of pkt, or its dts if it has none.
+	int64_t packet_time(const ff::packet& pkt);
+
+	/*
+	* @returns i, or the best video stream of m if i is -1.
+	* @throws std::runtime_error if m has no video streams, or if i is not one
+	*/
+	int choose_video_stream(const ff::input_media& m, int i);
+
+	// @returns the indices of all streams of m but i, in ascending order, e.g. the unused ports of a demuxer for stream i.
+	std::vector<int> all_streams_but(const ff::input_media& m, int i);
+
+	/*
+	* @returns where to seek next after seeking to target has landed missed_by after where it should have:
+	 twice as far back as it missed by, but not before 1, which demuxer::seek() takes for the start.
+	*/
+	int64_t seek_back_target(int64_t target, int64_t missed_by);
+
+	/*
+	* Feeds pkt to dec, which has just returned again() from receive().
+	* @throws std::runtime_error with what as the message if dec refuses it
+	*/
+	void feed_requested_packet(ff::decoder& dec, ff::packet& pkt, const char* what);
+}
@@ -0,0 +1,634 @@
+extern "C"
+{
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#include "async_input_io.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#include <liburing.h>
+#define FF_HAS_IO_URING 1
+#endif
+#endif
+
+namespace ff
+{
+	struct async_read_request
+	{
+		async_read_request() = default;
+		async_read_request(const async_read_request&) = delete;
+		~async_read_request() { av_free(buf); }
+
+		uint8_t* buf = nullptr;
+		size_t capacity = 0;
+
+		int64_t offset = 0;
+		// the number of bytes asked for
+		size_t length = 0;
+
+		// the number of bytes read, or a negative AVERROR code. Only valid once done.
+		int64_t result = 0;
+		// Written by the engine.
+		bool done = false;
+	};
+
+	// Carries out read requests in the background.
+	class async_read_engine
+	{
+	public:
+		virtual ~async_read_engine() = default;
+
+		// Starts reading req. @throws std::runtime_error on failure
+		virtual void submit(async_read_request* req) = 0;
+		// Waits until req is done.
+		virtual void wait(async_read_request* req) = 0;
+
+		virtual async_input_io::engine_type type() const = 0;
+	};
+}
+
+namespace
+{
+#if defined(_WIN32)
+	using file_handle_t = HANDLE;
+#else
+	using file_handle_t = int;
+#endif
+
+	// Reads len bytes at offset unless the end of the file comes first.
+	// @returns the number of bytes read, or a negative AVERROR code.
+	int64_t read_fully_at(file_handle_t file, uint8_t* buf, size_t len, int64_t offset)
+	{
+		size_t total = 0;
+		while (total != len)
+		{
+#if defined(_WIN32)
+			OVERLAPPED ov = {};
+			ov.Offset = (DWORD)((offset + total) & 0xFFFFFFFF);
+			ov.OffsetHigh = (DWORD)((offset + total) >> 32);
+			DWORD chunk = (DWORD)std::min(len - total, (size_t)1 << 30);
+			DWORD n = 0;
+			if (!ReadFile(file, buf + total, chunk, &n, &ov))
+			{
+				if (GetLastError() == ERROR_HANDLE_EOF)
+				{
+					break;
+				}
+				return AVERROR(EIO);
+			}
+#else
+			ssize_t n = pread(file, buf + total, len - total, (off_t)(offset + total));
+			if (n < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return AVERROR(errno);
+			}
+#endif
+			if (n == 0) // end of the file
+			{
+				break;
+			}
+			total += n;
+		}
+		return (int64_t)total;
+	}
+
+	// Positioned reads on a pool of threads.
+	class thread_pool_engine : public ff::async_read_engine
+	{
+	public:
+		thread_pool_engine(file_handle_t f, int num_threads) : file(f)
+		{
+			try
+			{
+				for (int i = 0; i < std::max(num_threads, 1); ++i)
+				{
+					workers.emplace_back(&thread_pool_engine::work, this);
+				}
+			}
+			catch (const std::system_error&)
+			{
+				stop();
+				ON_FF_ERROR("Could not start the threads to read the file.")
+			}
+		}
+
+		~thread_pool_engine() override { stop(); }
+
+		void submit(ff::async_read_request* req) override
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				req->done = false;
+				queue.push_back(req);
+			}
+			has_work.notify_one();
+		}
+
+		void wait(ff::async_read_request* req) override
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_done.wait(lock, [req]() { return req->done; });
+		}
+
+		ff::async_input_io::engine_type type() const override { return ff::async_input_io::engine_type::thread_pool; }
+
+	private:
+		void work()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true)
+			{
+				has_work.wait(lock, [this]() { return stopping || !queue.empty(); });
+				if (queue.empty()) // stopping
+				{
+					return;
+				}
+
+				auto req = queue.front();
+				queue.pop_front();
+
+				lock.unlock();
+				int64_t result = read_fully_at(file, req->buf, req->length, req->offset);
+				lock.lock();
+
+				req->result = result;
+				req->done = true;
+				work_done.notify_all();
+			}
+		}
+
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			has_work.notify_all();
+			for (auto& t : workers)
+			{
+				t.join();
+			}
+			workers.clear();
+		}
+
+	private:
+		file_handle_t file;
+
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable has_work, work_done;
+		std::deque<ff::async_read_request*> queue;
+		bool stopping = false;
+	};
+
+#if defined(FF_HAS_IO_URING)
+	// Reads through an io_uring, submitted and reaped on the thread of the demuxer.
+	class io_uring_engine : public ff::async_read_engine
+	{
+	public:
+		// @returns nullptr if io_uring is not available, e.g. on old kernels or in sandboxes that forbid it.
+		static std::unique_ptr<ff::async_read_engine> create(int fd, int entries)
+		{
+			std::unique_ptr<io_uring_engine> engine(new io_uring_engine(fd));
+			if (io_uring_queue_init((unsigned)std::max(entries, 1), &engine->ring, 0) < 0)
+			{
+				return nullptr;
+			}
+			engine->initialized = true;
+			return engine;
+		}
+
+		~io_uring_engine() override
+		{
+			if (initialized)
+			{
+				io_uring_queue_exit(&ring);
+			}
+		}
+
+		void submit(ff::async_read_request* req) override
+		{
+			req->done = false;
+
+			io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+			if (!sqe)
+			{
+				// The submission queue is full. Hand what's in it to the kernel to make room.
+				io_uring_submit(&ring);
+				sqe = io_uring_get_sqe(&ring);
+			}
+			if (!sqe)
+			{
+				ON_FF_ERROR("The io_uring submission queue is full.")
+			}
+
+			io_uring_prep_read(sqe, fd, req->buf, (unsigned)req->length, (uint64_t)req->offset);
+			io_uring_sqe_set_data(sqe, req);
+
+			int ret = io_uring_submit(&ring);
+			if (ret < 0)
+			{
+				ON_FF_ERROR_WITH_CODE("Could not submit a read to io_uring.", ret)
+			}
+		}
+
+		void wait(ff::async_read_request* req) override
+		{
+			// Completions come in any order. Mark whichever arrives until req is done.
+			while (!req->done)
+			{
+				io_uring_cqe* cqe = nullptr;
+				int ret = io_uring_wait_cqe(&ring, &cqe);
+				if (ret == -EINTR)
+				{
+					continue;
+				}
+				else if (ret < 0)
+				{
+					ON_FF_ERROR_WITH_CODE("Could not wait for a read from io_uring.", ret)
+				}
+
+				auto done_req = static_cast<ff::async_read_request*>(io_uring_cqe_get_data(cqe));
+				// res is the number of bytes or -errno, which is also the AVERROR code on POSIX.
+				done_req->result = cqe->res;
+				done_req->done = true;
+				io_uring_cqe_seen(&ring, cqe);
+			}
+		}
+
+		ff::async_input_io::engine_type type() const override { return ff::async_input_io::engine_type::io_uring; }
+
+	private:
+		explicit io_uring_engine(int f) : fd(f) {}
+
+	private:
+		int fd;
+		io_uring ring;
+		bool initialized = false;
+	};
+#endif
+}
+
+ff::async_input_io::async_input_io(const std::string& fp) :
+	async_input_io(fp, settings())
+{
+}
+
+ff::async_input_io::async_input_io(const std::string& fp, const settings& s) :
+	filepath(fp), opts(s)
+{
+	opts.initial_block_size = std::max(opts.initial_block_size, (size_t)64 * 1024);
+	opts.max_block_size = std::max(opts.max_block_size, opts.initial_block_size);
+	opts.initial_depth = std::max(opts.initial_depth, 1);
+	opts.max_depth = std::max(opts.max_depth, opts.initial_depth);
+
+	block_size = opts.initial_block_size;
+	depth = opts.initial_depth;
+
+#if defined(_WIN32)
+	file_handle = CreateFileW(std::filesystem::path(fp).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		ON_FF_ERROR("Could not open the file to read.")
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file_handle, &size))
+	{
+		CloseHandle(file_handle);
+		ON_FF_ERROR("Could not get the size of the file to read.")
+	}
+	file_size = size.QuadPart;
+
+	file_handle_t handle = file_handle;
+#else
+	fd = open(std::filesystem::path(fp).string().c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		ON_FF_ERROR("Could not open the file to read.")
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		ON_FF_ERROR("Could not get the size of the file to read.")
+	}
+	file_size = st.st_size;
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	file_handle_t handle = fd;
+#endif
+
+	try
+	{
+#if defined(FF_HAS_IO_URING)
+		if (opts.prefer_io_uring)
+		{
+			engine = io_uring_engine::create(fd, opts.max_depth);
+		}
+#endif
+		if (!engine)
+		{
+			engine = std::make_unique<thread_pool_engine>(handle, opts.num_threads);
+		}
+
+		stats.block_size = block_size;
+		stats.depth = depth;
+		period_start = std::chrono::steady_clock::now();
+
+		fill();
+	}
+	catch (const std::runtime_error&)
+	{
+		drain();
+		engine.reset();
+#if defined(_WIN32)
+		CloseHandle(file_handle);
+#else
+		close(fd);
+#endif
+		throw;
+	}
+}
+
+ff::async_input_io::~async_input_io()
+{
+	// The buffers must outlive the reads into them.
+	drain();
+	engine.reset();
+
+#if defined(_WIN32)
+	CloseHandle(file_handle);
+#else
+	close(fd);
+#endif
+}
+
+int ff::async_input_io::read(uint8_t* buf, int size)
+{
+	if (pos >= file_size)
+	{
+		return AVERROR_EOF;
+	}
+
+	try
+	{
+		while (true)
+		{
+			// pos is out of the blocks in flight, e.g. after a seek.
+			if (window.empty() || pos < window.front()->offset || pos >= next_offset)
+			{
+				restart();
+			}
+
+			async_read_request* req = window.front();
+			wait(req);
+
+			if (req->result < 0)
+			{
+				int err = (int)req->result;
+				// Start over at pos on the next call.
+				drain();
+				return err;
+			}
+			else if (req->result == 0)
+			{
+				// The file is shorter than it was when it was opened.
+				return AVERROR_EOF;
+			}
+
+			int64_t end = req->offset + req->result;
+			if (pos < end)
+			{
+				size_t n = (size_t)std::min((int64_t)size, end - pos);
+				std::memcpy(buf, req->buf + (pos - req->offset), n);
+				pos += n;
+
+				stats.num_bytes_read += n;
+				period_bytes += n;
+
+				if (pos == end)
+				{
+					window.pop_front();
+					free_requests.push_back(req);
+					fill();
+				}
+
+				if (opts.adaptive && period_bytes >= opts.adapt_period)
+				{
+					adapt();
+				}
+
+				return (int)n;
+			}
+
+			// pos is past this block, after a seek forward or a short read.
+			window.pop_front();
+			free_requests.push_back(req);
+			fill();
+		}
+	}
+	catch (const std::runtime_error&)
+	{
+		// read() is called by ffmpeg, which cannot take exceptions.
+		drain();
+		return AVERROR(EIO);
+	}
+}
+
+int64_t ff::async_input_io::seek(int64_t offset, int whence)
+{
+	int64_t base = 0;
+	switch (whence)
+	{
+	case SEEK_SET:
+		base = 0;
+		break;
+	case SEEK_CUR:
+		base = pos;
+		break;
+	case SEEK_END:
+		base = file_size;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	if (base + offset < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	// The blocks in flight are kept. read() starts over if the new position is out of them.
+	pos = base + offset;
+	return pos;
+}
+
+ff::async_input_io::engine_type ff::async_input_io::get_engine_type() const
+{
+	return engine->type();
+}
+
+void ff::async_input_io::restart()
+{
+	drain();
+	next_offset = pos;
+	fill();
+}
+
+void ff::async_input_io::drain()
+{
+	for (auto req : window)
+	{
+		engine->wait(req);
+		free_requests.push_back(req);
+	}
+	window.clear();
+}
+
+void ff::async_input_io::fill()
+{
+	while ((int)window.size() < depth && next_offset < file_size)
+	{
+		async_read_request* req = take_free_request();
+		req->offset = next_offset;
+		req->length = (size_t)std::min((int64_t)block_size, file_size - next_offset);
+
+		// take it back before submitting, so that a failure leaves nothing in flight behind.
+		free_requests.push_back(req);
+		engine->submit(req);
+		free_requests.pop_back();
+
+		window.push_back(req);
+		next_offset += req->length;
+		++stats.num_requests;
+	}
+}
+
+ff::async_read_request* ff::async_input_io::take_free_request()
+{
+	async_read_request* req = nullptr;
+	if (!free_requests.empty())
+	{
+		req = free_requests.back();
+		free_requests.pop_back();
+	}
+	else
+	{
+		requests.push_back(std::make_unique<async_read_request>());
+		req = requests.back().get();
+	}
+
+	if (req->capacity < block_size)
+	{
+		av_freep(&req->buf);
+		req->capacity = 0;
+
+		req->buf = (uint8_t*)av_malloc(block_size);
+		if (!req->buf)
+		{
+			free_requests.push_back(req);
+			ON_FF_ERROR("Could not allocate the buffer of a read.")
+		}
+		req->capacity = block_size;
+	}
+
+	return req;
+}
+
+void ff::async_input_io::wait(async_read_request* req)
+{
+	auto start = std::chrono::steady_clock::now();
+	engine->wait(req);
+	auto waited = std::chrono::steady_clock::now() - start;
+
+	stats.wait_time += waited;
+	period_wait += waited;
+}
+
+void ff::async_input_io::adapt()
+{
+	auto now = std::chrono::steady_clock::now();
+	auto elapsed = now - period_start;
+	double throughput = period_bytes / std::chrono::duration<double>(elapsed).count();
+
+	// Only worth tuning if the demuxer spends a noticeable part of its time waiting for the reads.
+	bool io_bound = period_wait * 20 > elapsed;
+
+	if (!io_bound)
+	{
+		last_step = tuning_step::none;
+	}
+	else if (last_step != tuning_step::none && throughput < last_throughput * 1.05)
+	{
+		// The last step did not help. Take it back and don't try that way again.
+		if (last_step == tuning_step::depth)
+		{
+			depth /= 2;
+			depth_exhausted = true;
+		}
+		else
+		{
+			block_size /= 2;
+			block_size_exhausted = true;
+		}
+		last_step = tuning_step::none;
+	}
+	else
+	{
+		// Grow the depth first, as it does not change the size of the reads the device sees.
+		last_step = tuning_step::none;
+		if (!depth_exhausted && depth * 2 <= opts.max_depth)
+		{
+			depth *= 2;
+			last_step = tuning_step::depth;
+		}
+		else if (!block_size_exhausted && block_size * 2 <= opts.max_block_size)
+		{
+			block_size *= 2;
+			last_step = tuning_step::block_size;
+		}
+	}
+
+	last_throughput = throughput;
+	period_bytes = 0;
+	period_wait = std::chrono::nanoseconds(0);
+	period_start = now;
+
+	stats.block_size = block_size;
+	stats.depth = depth;
+
+	fill();
+}
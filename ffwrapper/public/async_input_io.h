@@ -0,0 +1,150 @@
+/*
+* async_input_io.h:
+* Defines an input_io that keeps several large reads of a local file in flight ahead of the demuxer.
+*/
+
+#pragma once
+
+#include "input_io.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace ff
+{
+	struct async_read_request;
+	class async_read_engine;
+
+	/*
+	* Reads a local file ahead of the position in blocks, with up to a queue depth of them in flight at once,
+	* and serves ffmpeg from the blocks that are completed.
+	*
+	* The reads are done by io_uring on Linux when liburing is available and the kernel allows it,
+	* and by a pool of threads doing positioned reads (pread, or ReadFile at an offset on Windows) otherwise.
+	*
+	* If settings::adaptive, the block size and the queue depth are tuned while reading:
+	* as long as the demuxer waits for the reads, they are doubled in turn, and a step that does not raise
+	* the throughput is taken back.
+	*
+	* A seek inside the blocks in flight keeps them. Any other seek waits for them and starts reading at the new position.
+	*/
+	class async_input_io : public input_io
+	{
+	public:
+		enum class engine_type
+		{
+			io_uring,
+			thread_pool
+		};
+
+		struct settings
+		{
+			size_t initial_block_size = 1024 * 1024;
+			size_t max_block_size = 8 * 1024 * 1024;
+			int initial_depth = 4;
+			int max_depth = 32;
+
+			// Tunes the block size and the queue depth to the measured throughput.
+			bool adaptive = true;
+			// The number of bytes consumed between two tunings.
+			size_t adapt_period = 64 * 1024 * 1024;
+
+			// Uses io_uring if possible. Otherwise always uses the thread pool.
+			bool prefer_io_uring = true;
+			// The number of threads of the thread pool.
+			int num_threads = 4;
+		};
+
+		struct statistics
+		{
+			uint64_t num_bytes_read = 0;
+			uint64_t num_requests = 0;
+			// total time read() waited for blocks to complete
+			std::chrono::nanoseconds wait_time{ 0 };
+			// the current tuning
+			size_t block_size = 0;
+			int depth = 0;
+		};
+
+	public:
+		async_input_io() = delete;
+		/*
+		* Opens the file at fp and starts reading it from the beginning.
+		* @throws std::runtime_error if the file cannot be opened or the engine cannot be started
+		*/
+		async_input_io(const std::string& fp, const settings& s);
+		// Uses the default settings.
+		explicit async_input_io(const std::string& fp);
+
+		// Waits for the reads in flight and closes the file.
+		~async_input_io() override;
+
+	public:
+		int read(uint8_t* buf, int size) override;
+		int64_t seek(int64_t offset, int whence) override;
+		int64_t size() const override { return file_size; }
+
+		std::string url() const override { return filepath; }
+
+	public:
+		engine_type get_engine_type() const;
+
+		const statistics& get_statistics() const { return stats; }
+
+	private:
+		// Waits for all requests in flight and starts reading at pos.
+		void restart();
+		// Waits for all requests in flight and keeps them as free requests.
+		void drain();
+		// Issues requests after the last one until there are depth of them.
+		void fill();
+		// @returns a free request whose buffer holds at least block_size bytes.
+		async_read_request* take_free_request();
+		// Waits for req and adds the time to the statistics.
+		void wait(async_read_request* req);
+
+		// Changes the block size or the queue depth after each adapt_period bytes.
+		void adapt();
+
+	private:
+		std::string filepath;
+		settings opts;
+		int64_t file_size = 0;
+
+		int64_t pos = 0;
+		// the offset of the next request to issue
+		int64_t next_offset = 0;
+
+#if defined(_WIN32)
+		void* file_handle = nullptr;
+#else
+		int fd = -1;
+#endif
+
+		std::unique_ptr<async_read_engine> engine;
+
+		// all requests, for freeing them
+		std::vector<std::unique_ptr<async_read_request>> requests;
+		// requests in flight or completed but not consumed, in the order of their offsets
+		std::deque<async_read_request*> window;
+		std::vector<async_read_request*> free_requests;
+
+		size_t block_size = 0;
+		int depth = 0;
+
+		// tuning state
+		enum class tuning_step { none, depth, block_size };
+		tuning_step last_step = tuning_step::none;
+		bool depth_exhausted = false, block_size_exhausted = false;
+		double last_throughput = 0.;
+		size_t period_bytes = 0;
+		std::chrono::nanoseconds period_wait{ 0 };
+		std::chrono::steady_clock::time_point period_start;
+
+		statistics stats;
+	};
+}
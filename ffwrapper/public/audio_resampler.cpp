@@ -67,6 +67,9 @@ int ff::audio_resampler::convert(const frame& src_frame, frame& dst_frame)
 {
 	int ret;
 
+	// dst may share its buffer with other frames. The samples are overwritten, so there is nothing to copy.
+	dst_frame.make_writable_without_copy();
+
 	if ((ret = swr_convert_frame(swr_ctx, dst_frame, src_frame)) < 0)
 	{
 		ON_FF_ERROR_WITH_CODE("Could not convert audio samples.", ret)
@@ -0,0 +1,422 @@
+extern "C"
+{
+#include <libavutil/error.h>
+}
+
+#include "buffered_output_io.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <malloc.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#endif
+
+namespace
+{
+#if defined(_WIN32)
+	using file_handle_t = HANDLE;
+#else
+	using file_handle_t = int;
+#endif
+
+	// Direct I/O needs buffers, offsets and lengths aligned to the logical block size of the device.
+	// The page size covers the devices in use.
+	constexpr size_t alignment = 4096;
+
+	uint8_t* alloc_aligned(size_t size)
+	{
+#if defined(_WIN32)
+		return (uint8_t*)_aligned_malloc(size, alignment);
+#else
+		void* p = nullptr;
+		return posix_memalign(&p, alignment, size) == 0 ? (uint8_t*)p : nullptr;
+#endif
+	}
+
+	void free_aligned(uint8_t* p)
+	{
+#if defined(_WIN32)
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+
+	// Writes len bytes at offset.
+	// @param num_calls: incremented for each system call.
+	// @returns 0, or a negative AVERROR code.
+	int write_fully_at(file_handle_t file, const uint8_t* buf, size_t len, int64_t offset, uint64_t& num_calls)
+	{
+		size_t total = 0;
+		while (total != len)
+		{
+			++num_calls;
+#if defined(_WIN32)
+			OVERLAPPED ov = {};
+			ov.Offset = (DWORD)((offset + total) & 0xFFFFFFFF);
+			ov.OffsetHigh = (DWORD)((offset + total) >> 32);
+			DWORD chunk = (DWORD)std::min(len - total, (size_t)1 << 30);
+			DWORD n = 0;
+			if (!WriteFile(file, buf + total, chunk, &n, &ov))
+			{
+				return AVERROR(EIO);
+			}
+#else
+			ssize_t n = pwrite(file, buf + total, len - total, (off_t)(offset + total));
+			if (n < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return AVERROR(errno);
+			}
+#endif
+			if (n == 0)
+			{
+				return AVERROR(EIO);
+			}
+			total += n;
+		}
+		return 0;
+	}
+}
+
+ff::buffered_output_io::buffered_output_io(const std::string& fp) :
+	buffered_output_io(fp, settings())
+{
+}
+
+ff::buffered_output_io::buffered_output_io(const std::string& fp, const settings& s) :
+	filepath(fp), opts(s)
+{
+	if (opts.block_size == 0)
+	{
+		opts.block_size = settings().block_size;
+	}
+	opts.block_size = (opts.block_size + alignment - 1) / alignment * alignment;
+	// One block is filled while the others are written.
+	opts.num_blocks = std::max(opts.num_blocks, opts.background_flush ? 2 : 1);
+
+#if defined(_WIN32)
+	file_handle = CreateFileW(std::filesystem::path(fp).wstring().c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		ON_FF_ERROR("Could not open or create the output file.")
+	}
+
+	if (opts.direct)
+	{
+		direct_handle = CreateFileW(std::filesystem::path(fp).wstring().c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+			OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+		// Go through the cache if the file system does not allow it.
+		if (direct_handle == INVALID_HANDLE_VALUE)
+		{
+			direct_handle = nullptr;
+		}
+	}
+
+	if (opts.expected_size > 0)
+	{
+		// Reserves the clusters without moving the end of the file. It's fine if it fails.
+		FILE_ALLOCATION_INFO info;
+		info.AllocationSize.QuadPart = opts.expected_size;
+		SetFileInformationByHandle(file_handle, FileAllocationInfo, &info, sizeof(info));
+	}
+#else
+	fd = open(std::filesystem::path(fp).string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		ON_FF_ERROR("Could not open or create the output file.")
+	}
+
+#if defined(O_DIRECT)
+	if (opts.direct)
+	{
+		// Go through the cache if the file system does not allow it (e.g. tmpfs).
+		direct_fd = open(std::filesystem::path(fp).string().c_str(), O_WRONLY | O_DIRECT);
+	}
+#endif
+
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+	if (opts.expected_size > 0)
+	{
+		// Reserves the blocks without moving the end of the file. It's fine if it fails.
+		fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)opts.expected_size);
+	}
+#endif
+#endif
+
+	blocks.resize(opts.num_blocks);
+	for (auto& b : blocks)
+	{
+		b.data = alloc_aligned(opts.block_size);
+		if (!b.data)
+		{
+			close_file();
+			ON_FF_ERROR("Could not allocate the blocks to write the output file.")
+		}
+	}
+
+	current = &blocks[0];
+	for (size_t i = 1; i < blocks.size(); ++i)
+	{
+		free_blocks.push_back(&blocks[i]);
+	}
+	current->offset = 0;
+	current->length = 0;
+	current->limit = opts.block_size;
+
+	if (opts.background_flush)
+	{
+		try
+		{
+			writer = std::thread(&buffered_output_io::writer_loop, this);
+		}
+		catch (const std::system_error& e)
+		{
+			close_file();
+			ON_FF_ERROR(std::string("Could not start the thread to write the output file. ") + e.what())
+		}
+	}
+}
+
+ff::buffered_output_io::~buffered_output_io()
+{
+	finish();
+	close_file();
+}
+
+int ff::buffered_output_io::write(const uint8_t* buf, int size)
+{
+	size_t done = 0;
+	while (done < (size_t)size)
+	{
+		size_t n = std::min((size_t)size - done, current->limit - current->length);
+		std::memcpy(current->data + current->length, buf + done, n);
+		current->length += n;
+		done += n;
+		pos += n;
+
+		if (current->length == current->limit)
+		{
+			submit_current();
+		}
+	}
+	file_size = std::max(file_size, pos);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return error < 0 ? error : size;
+}
+
+int64_t ff::buffered_output_io::seek(int64_t offset, int whence)
+{
+	int64_t base = 0;
+	switch (whence)
+	{
+	case SEEK_SET:
+		base = 0;
+		break;
+	case SEEK_CUR:
+		base = pos;
+		break;
+	case SEEK_END:
+		base = file_size;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	int64_t new_pos = base + offset;
+	if (new_pos < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	if (new_pos != pos)
+	{
+		// A block only holds consecutive bytes. The blocks are written in order,
+		// so whatever is written at the new position lands after what was written there before.
+		submit_current();
+		pos = new_pos;
+		current->offset = pos;
+		current->limit = opts.block_size - (size_t)(pos % alignment);
+	}
+	return new_pos;
+}
+
+int ff::buffered_output_io::finish()
+{
+	submit_current();
+	wait_idle();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return error;
+}
+
+void ff::buffered_output_io::submit_current()
+{
+	if (current->length != 0)
+	{
+		if (opts.background_flush)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queue.push_back(current);
+			}
+			has_work.notify_one();
+			current = take_free_block();
+		}
+		else
+		{
+			int err = write_block(*current);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (err < 0 && error == 0)
+			{
+				error = err;
+			}
+		}
+	}
+
+	// Ends at an aligned offset, so that the next blocks are aligned again after a seek.
+	current->offset = pos;
+	current->length = 0;
+	current->limit = opts.block_size - (size_t)(pos % alignment);
+}
+
+ff::buffered_output_io::block* ff::buffered_output_io::take_free_block()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (free_blocks.empty())
+	{
+		auto start = std::chrono::steady_clock::now();
+		block_freed.wait(lock, [this]() { return !free_blocks.empty(); });
+		stats.wait_time += std::chrono::steady_clock::now() - start;
+	}
+
+	block* b = free_blocks.back();
+	free_blocks.pop_back();
+	return b;
+}
+
+void ff::buffered_output_io::wait_idle()
+{
+	if (!opts.background_flush)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	block_freed.wait(lock, [this]() { return queue.empty() && !writing; });
+}
+
+int ff::buffered_output_io::write_block(const block& b)
+{
+	if (b.length == 0)
+	{
+		return 0;
+	}
+
+	bool aligned = b.offset % alignment == 0 && b.length % alignment == 0;
+
+#if defined(_WIN32)
+	file_handle_t handle = (aligned && direct_handle) ? direct_handle : file_handle;
+#else
+	file_handle_t handle = (aligned && direct_fd >= 0) ? direct_fd : fd;
+#endif
+
+	int err = write_fully_at(handle, b.data, b.length, b.offset, stats.num_writes);
+	if (err == 0)
+	{
+		stats.num_bytes_written += b.length;
+	}
+	return err;
+}
+
+void ff::buffered_output_io::writer_loop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		has_work.wait(lock, [this]() { return stopping || !queue.empty(); });
+		if (queue.empty()) // stopping
+		{
+			return;
+		}
+
+		block* b = queue.front();
+		queue.pop_front();
+		writing = true;
+
+		lock.unlock();
+		int err = write_block(*b);
+		lock.lock();
+
+		if (err < 0 && error == 0)
+		{
+			error = err;
+		}
+		writing = false;
+		free_blocks.push_back(b);
+		block_freed.notify_all();
+	}
+}
+
+void ff::buffered_output_io::close_file()
+{
+	if (writer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		has_work.notify_all();
+		writer.join();
+	}
+
+	for (auto& b : blocks)
+	{
+		free_aligned(b.data);
+		b.data = nullptr;
+	}
+
+#if defined(_WIN32)
+	if (direct_handle)
+	{
+		CloseHandle(direct_handle);
+		direct_handle = nullptr;
+	}
+	if (file_handle)
+	{
+		CloseHandle(file_handle);
+		file_handle = nullptr;
+	}
+#else
+	if (direct_fd >= 0)
+	{
+		close(direct_fd);
+		direct_fd = -1;
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+		fd = -1;
+	}
+#endif
+}
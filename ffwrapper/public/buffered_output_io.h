@@ -0,0 +1,158 @@
+/*
+* buffered_output_io.h:
+* Defines an output_io that writes a local file in large aligned blocks, optionally on a thread of its own.
+*/
+
+#pragma once
+
+#include "output_io.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ff
+{
+	/*
+	* Gathers the bytes from ffmpeg into large blocks aligned to the page size and writes each of them with one system call,
+	* instead of one call per small AVIOContext buffer.
+	*
+	* If settings::background_flush, full blocks are written by a thread of its own while the muxer fills the next one.
+	* The muxer only waits when all blocks are waiting to be written.
+	*
+	* If settings::expected_size is given, that much space is reserved for the file up front (fallocate on Linux,
+	 the allocation size on Windows) without changing its size, so that a long export is not fragmented.
+	*
+	* If settings::direct, full blocks at aligned offsets bypass the page cache (O_DIRECT, or FILE_FLAG_NO_BUFFERING on Windows).
+	* Whatever is not aligned, e.g. the last block and the fields a muxer goes back to fill in, is written through the cache.
+	*
+	* The bytes held back are only written by finish() (which muxer::finalize() calls), by a seek, or on destruction.
+	* Thus, muxer options that read the file back while it's being written, such as movflags +faststart, are not supported.
+	*/
+	class buffered_output_io : public output_io
+	{
+	public:
+		struct settings
+		{
+			// The size of each block. Rounded up to a multiple of the alignment.
+			size_t block_size = 4 * 1024 * 1024;
+			// The number of blocks. At least 2 are needed for background_flush to overlap anything.
+			int num_blocks = 4;
+
+			// The estimated size of the output in bytes, which is reserved up front. 0 to reserve nothing.
+			int64_t expected_size = 0;
+
+			// Writes full blocks on a thread of its own.
+			bool background_flush = true;
+			// Bypasses the page cache for full aligned blocks.
+			bool direct = false;
+		};
+
+		struct statistics
+		{
+			uint64_t num_bytes_written = 0;
+			// the number of write system calls
+			uint64_t num_writes = 0;
+			// total time write() waited for a free block
+			std::chrono::nanoseconds wait_time{ 0 };
+		};
+
+	public:
+		buffered_output_io() = delete;
+		/*
+		* Creates or truncates the file at fp.
+		* @throws std::runtime_error if the file cannot be opened, or the thread cannot be started
+		*/
+		buffered_output_io(const std::string& fp, const settings& s);
+		// Uses the default settings.
+		explicit buffered_output_io(const std::string& fp);
+
+		// Writes out whatever is held back, stops the thread and closes the file. Errors are ignored; call finish() to see them.
+		~buffered_output_io() override;
+
+	public:
+		int write(const uint8_t* buf, int size) override;
+		int64_t seek(int64_t offset, int whence) override;
+		int64_t size() const override { return file_size; }
+
+		// Larger than the default, as each call to write() copies into a block anyway.
+		int buffer_size() const override { return 256 * 1024; }
+		std::string url() const override { return filepath; }
+
+		/*
+		* Writes out the current block and waits for all blocks to be written.
+		* @returns 0, or the AVERROR code of the first write that failed.
+		*/
+		int finish() override;
+
+	public:
+		const statistics& get_statistics() const { return stats; }
+
+	private:
+		struct block
+		{
+			uint8_t* data = nullptr;
+			// the offset in the file of the first byte
+			int64_t offset = 0;
+			// the number of bytes held
+			size_t length = 0;
+			// the number of bytes it can hold, so that it ends at an aligned offset
+			size_t limit = 0;
+		};
+
+	private:
+		// Hands the current block to the writer if it holds anything, and takes a free one starting at pos.
+		void submit_current();
+		// Waits for a free block.
+		block* take_free_block();
+		// Waits until all blocks handed to the writer are written.
+		void wait_idle();
+
+		// Writes b to the file. @returns 0 or a negative AVERROR code.
+		int write_block(const block& b);
+		// The body of the writer thread.
+		void writer_loop();
+
+		// Stops the thread and closes the file.
+		void close_file();
+
+	private:
+		std::string filepath;
+		settings opts;
+
+		int64_t pos = 0;
+		int64_t file_size = 0;
+
+#if defined(_WIN32)
+		void* file_handle = nullptr;
+		// the handle for writes that bypass the cache. nullptr unless settings::direct.
+		void* direct_handle = nullptr;
+#else
+		int fd = -1;
+		// the descriptor for writes that bypass the cache. -1 unless settings::direct.
+		int direct_fd = -1;
+#endif
+
+		std::vector<block> blocks;
+		block* current = nullptr;
+
+		// Shared with the writer thread.
+		std::thread writer;
+		std::mutex mutex;
+		std::condition_variable has_work, block_freed;
+		std::deque<block*> queue;
+		std::vector<block*> free_blocks;
+		// true while the writer writes a block it took out of the queue
+		bool writing = false;
+		bool stopping = false;
+		// the first error of the writer
+		int error = 0;
+
+		statistics stats;
+	};
+}
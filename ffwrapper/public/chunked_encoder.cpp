@@ -0,0 +1,409 @@
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "chunked_encoder.h"
+#include "decoder.h"
+#include "media.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <system_error>
+
+namespace
+{
+	// @returns true iff the packets of a and b can be put into the same stream.
+	bool same_stream(const ff::encoder& a, const ff::encoder& b)
+	{
+		const AVCodecContext* x = a.get_codec_ctx();
+		const AVCodecContext* y = b.get_codec_ctx();
+
+		return x->codec_id == y->codec_id && x->pix_fmt == y->pix_fmt &&
+			x->width == y->width && x->height == y->height &&
+			av_cmp_q(x->time_base, y->time_base) == 0 &&
+			x->extradata_size == y->extradata_size &&
+			(x->extradata_size == 0 || std::memcmp(x->extradata, y->extradata, x->extradata_size) == 0);
+	}
+}
+
+ff::chunked_encoder::chunked_encoder(const decoder& dec, const output_media& m, int ID) :
+	chunked_encoder(dec, m, ID, settings())
+{
+}
+
+ff::chunked_encoder::chunked_encoder(const decoder& dec, const output_media& m, const char* name) :
+	chunked_encoder(dec, m, name, settings())
+{
+}
+
+ff::chunked_encoder::chunked_encoder(const decoder& dec, const output_media& m, int ID, const settings& s) :
+	opts(s), last_dts(AV_NOPTS_VALUE)
+{
+	make_enc = [&dec, &m, ID]() { return std::unique_ptr<encoder>(new transcode_encoder(dec, m, ID)); };
+	start();
+}
+
+ff::chunked_encoder::chunked_encoder(const decoder& dec, const output_media& m, const char* name, const settings& s) :
+	opts(s), last_dts(AV_NOPTS_VALUE)
+{
+	std::string n(name);
+	make_enc = [&dec, &m, n]() { return std::unique_ptr<encoder>(new transcode_encoder(dec, m, n.c_str())); };
+	start();
+}
+
+ff::chunked_encoder::~chunked_encoder()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	frame_put.notify_all();
+	frame_taken.notify_all();
+	packet_put.notify_all();
+
+	for (auto& t : workers)
+	{
+		t.join();
+	}
+}
+
+void ff::chunked_encoder::start()
+{
+	if (opts.num_workers <= 0)
+	{
+		opts.num_workers = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	opts.min_chunk_frames = std::max(opts.min_chunk_frames, 1);
+	opts.max_chunk_frames = std::max(opts.max_chunk_frames, opts.min_chunk_frames);
+	opts.max_buffered_frames = std::max<size_t>(opts.max_buffered_frames, 1);
+
+	stream_enc = make_enc();
+
+	try
+	{
+		for (int w = 0; w != opts.num_workers; ++w)
+		{
+			workers.emplace_back(&chunked_encoder::worker_loop, this);
+		}
+	}
+	catch (const std::system_error& e)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		frame_put.notify_all();
+		for (auto& t : workers)
+		{
+			t.join();
+		}
+		ON_FF_ERROR(std::string("Could not start the workers to encode chunks. ") + e.what())
+	}
+}
+
+bool ff::chunked_encoder::try_feed(ff::frame& f)
+{
+	// The detector may take a while, so not while holding the lock.
+	bool scene_cut = opts.is_scene_cut && opts.is_scene_cut(f);
+	ff::frame ref(f);
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		check_error();
+		if (draining)
+		{
+			return false;
+		}
+
+		auto wait_start = std::chrono::steady_clock::now();
+		frame_taken.wait(lock, [this]() { return stopping || error || buffered_frames < opts.max_buffered_frames; });
+		stats.feed_wait_time += std::chrono::steady_clock::now() - wait_start;
+		check_error();
+
+#if defined(AV_FRAME_FLAG_KEY)
+		bool keyframe = f->flags & AV_FRAME_FLAG_KEY;
+#else
+		// FFmpeg before 6.1
+		bool keyframe = f->key_frame;
+#endif
+		if (chunks.empty() || current_frames >= opts.max_chunk_frames ||
+			(current_frames >= opts.min_chunk_frames && (keyframe || scene_cut)))
+		{
+			open_chunk(lock);
+		}
+
+		chunks.back()->frames.push_back(std::move(ref));
+		++current_frames;
+		++buffered_frames;
+		++stats.num_frames;
+	}
+	frame_put.notify_all();
+
+	return true;
+}
+
+void ff::chunked_encoder::open_chunk(std::unique_lock<std::mutex>& lock)
+{
+	// The chunk before can be drained while the encoder is created.
+	if (!chunks.empty())
+	{
+		chunks.back()->closed = true;
+		frame_put.notify_all();
+	}
+
+	// Creating an encoder takes a while.
+	lock.unlock();
+	std::unique_ptr<encoder> enc = make_enc();
+	if (!same_stream(*enc, *stream_enc))
+	{
+		ON_FF_ERROR("The encoder of a chunk does not have the parameters of the stream. Has the format of the decoder changed?")
+	}
+	lock.lock();
+
+	auto c = std::make_unique<chunk>();
+	c->enc = std::move(enc);
+	chunks.push_back(std::move(c));
+	current_frames = 0;
+	++stats.num_chunks;
+}
+
+void ff::chunked_encoder::worker_loop()
+{
+	try
+	{
+		while (true)
+		{
+			chunk* c = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				// Chunks are taken in order, so the ones whose packets are taken first are encoded first.
+				frame_put.wait(lock, [this, &c]()
+					{
+						auto it = std::find_if(chunks.begin(), chunks.end(), [](const std::unique_ptr<chunk>& ch) { return !ch->taken; });
+						c = it != chunks.end() ? it->get() : nullptr;
+						return stopping || c != nullptr;
+					});
+				if (stopping)
+				{
+					break;
+				}
+				c->taken = true;
+			}
+
+			encode_chunk(*c);
+		}
+	}
+	catch (...)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+			{
+				error = std::current_exception();
+			}
+			stopping = true;
+		}
+		frame_put.notify_all();
+		frame_taken.notify_all();
+		packet_put.notify_all();
+	}
+}
+
+void ff::chunked_encoder::encode_chunk(chunk& c)
+{
+	// Only this worker uses the encoder once the chunk is taken.
+	encoder& enc = *c.enc;
+
+	while (true)
+	{
+		ff::frame f(nullptr);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			frame_put.wait(lock, [this, &c]() { return stopping || !c.frames.empty() || c.closed; });
+			if (stopping)
+			{
+				return;
+			}
+			if (c.frames.empty())
+			{
+				// closed
+				break;
+			}
+
+			f = std::move(c.frames.front());
+			c.frames.pop_front();
+			--buffered_frames;
+		}
+		frame_taken.notify_all();
+
+		status st;
+		while ((st = enc.feed(f)).again())
+		{
+			// The encoder wants its packets taken first.
+			receive_packets(enc, c);
+		}
+		if (!st.ok())
+		{
+			ON_FF_ERROR_WITH_CODE("Could not feed a frame to the encoder of a chunk.", st.code)
+		}
+
+		receive_packets(enc, c);
+	}
+
+	enc.start_draining();
+	status st = receive_packets(enc, c);
+	if (!st.eof())
+	{
+		ON_FF_ERROR_WITH_CODE("Could not drain the encoder of a chunk.", st.code)
+	}
+
+	std::unique_ptr<encoder> drained;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		c.done = true;
+		drained = std::move(c.enc);
+	}
+	packet_put.notify_all();
+	// drained is destroyed here, which joins its threads, outside of the lock.
+}
+
+ff::status ff::chunked_encoder::receive_packets(encoder& enc, chunk& c)
+{
+	std::vector<ff::packet> got;
+
+	status st;
+	while (true)
+	{
+		ff::packet pkt(nullptr);
+		if (!(st = enc.receive(pkt)).ok())
+		{
+			break;
+		}
+		got.push_back(std::move(pkt));
+	}
+	if (st.is_error())
+	{
+		ON_FF_ERROR_WITH_CODE("Could not encode a packet of a chunk.", st.code)
+	}
+
+	if (!got.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& pkt : got)
+			{
+				c.packets.push_back(std::move(pkt));
+			}
+		}
+		packet_put.notify_all();
+	}
+
+	return st;
+}
+
+ff::packet ff::chunked_encoder::get_one(std::unique_lock<std::mutex>& lock, bool wait)
+{
+	while (true)
+	{
+		check_error();
+
+		if (!chunks.empty())
+		{
+			chunk& c = *chunks.front();
+			if (!c.packets.empty())
+			{
+				ff::packet pkt = std::move(c.packets.front());
+				c.packets.pop_front();
+
+				// The first packets of a chunk may be stamped before the last ones of the chunk before.
+				// Shifting the whole chunk keeps its dts as far apart as its encoder made them.
+				if (pkt->dts != AV_NOPTS_VALUE)
+				{
+					if (!c.dts_shift_known)
+					{
+						c.dts_shift = last_dts != AV_NOPTS_VALUE && pkt->dts <= last_dts ? last_dts + 1 - pkt->dts : 0;
+						c.dts_shift_known = true;
+					}
+					if (c.dts_shift != 0)
+					{
+						pkt->dts += c.dts_shift;
+						if (pkt->pts != AV_NOPTS_VALUE && pkt->dts > pkt->pts)
+						{
+							ON_FF_ERROR("The packets of a chunk cannot follow those of the chunk before, as its encoder reorders more frames.")
+						}
+						++stats.num_dts_fixes;
+					}
+					last_dts = pkt->dts;
+				}
+
+				++stats.num_packets;
+				return pkt;
+			}
+			if (c.done)
+			{
+				chunks.pop_front();
+				continue;
+			}
+		}
+		else if (draining)
+		{
+			return ff::packet(nullptr);
+		}
+
+		if (!wait)
+		{
+			return ff::packet(nullptr);
+		}
+		packet_put.wait(lock);
+	}
+}
+
+ff::packet ff::chunked_encoder::try_get_one()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return get_one(lock, false);
+}
+
+ff::packet ff::chunked_encoder::wait_and_get_one()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return get_one(lock, true);
+}
+
+void ff::chunked_encoder::start_draining()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		draining = true;
+		if (!chunks.empty())
+		{
+			chunks.back()->closed = true;
+		}
+	}
+	frame_put.notify_all();
+	packet_put.notify_all();
+}
+
+bool ff::chunked_encoder::eof() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return draining && chunks.empty();
+}
+
+ff::chunked_encoder::statistics ff::chunked_encoder::get_statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void ff::chunked_encoder::check_error() const
+{
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
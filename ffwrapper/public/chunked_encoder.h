@@ -0,0 +1,214 @@
+/*
+* chunked_encoder.h:
+* Defines chunked_encoder, which encodes chunks of one video stream on several encoders at once.
+*/
+
+#pragma once
+
+#include "encoder.h"
+#include "frame.h"
+#include "interfaces/src_sink.h"
+
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace ff
+{
+	/*
+	* Encodes a stream of video frames as chunks, each on a transcode_encoder of its own, with several workers at once,
+	 and puts the packets of the chunks one after another into one stream.
+	*
+	* A single encoder stops scaling at a few threads, while chunks that start with a keyframe can be encoded independently.
+	* A chunk is cut at a keyframe of the source, or at a scene cut if a detector is set, once it has settings::min_chunk_frames,
+	 and is always cut at settings::max_chunk_frames.
+	*
+	* Every chunk encoder is created from the same decoder and output media, so they have the same parameters,
+	 time base and extradata, which are those of get_stream_encoder(): add the output stream with it.
+	 A chunk encoder that comes out different (e.g. as the decoder switched formats) is an error.
+	* The frames keep their pts, so the packets of consecutive chunks continue each other. If the first dts of a chunk
+	 would not be after the last one of the chunk before (e.g. as its encoder reorders more), the dts of the whole chunk
+	 are shifted by the same amount. A shift that would put a dts after its pts is an error: give every chunk encoder
+	 the same reordering (e.g. the same number of B-frames).
+	*
+	* The encoders of the chunks are created on the thread that feeds the frames, as they read the state of the decoder.
+	*
+	* Usage, like an encoder:
+	* 1. output.add_stream(enc.get_stream_encoder()), then write the file header.
+	* 2. try_feed() the frames, and take the packets with try_get_one() in between.
+	* 3. start_draining(), then wait_and_get_one() until an invalid packet comes out.
+	*/
+	class chunked_encoder : public frame_sink, public packet_source
+	{
+	public:
+		struct settings
+		{
+			// The number of workers. 0 for one per core. Each chunk encoder is left at its own threading.
+			int num_workers = 0;
+
+			// A chunk is cut at a keyframe of the source or at a scene cut only once it has this many frames.
+			int min_chunk_frames = 48;
+			// A chunk is cut here in any case.
+			int max_chunk_frames = 250;
+			// @returns true if f starts a new scene. Called with each frame on the feeding thread. Optional.
+			std::function<bool(const ff::frame& f)> is_scene_cut;
+
+			/*
+			* The most frames fed but not yet encoded, over all chunks. try_feed() waits while there are this many.
+			* Each is a full decoded picture (about 3 MB at 1080p), but the workers need a chunk each to run in parallel.
+			*/
+			size_t max_buffered_frames = 512;
+		};
+
+		struct statistics
+		{
+			uint64_t num_chunks = 0;
+			uint64_t num_frames = 0;
+			uint64_t num_packets = 0;
+			// the packets whose dts was shifted to keep it increasing from a chunk to the next
+			uint64_t num_dts_fixes = 0;
+			// total time try_feed() waited for the workers
+			std::chrono::nanoseconds feed_wait_time{ 0 };
+		};
+
+	public:
+		chunked_encoder() = delete;
+		/*
+		* Encodes frames decoded by dec for m with the encoder of the ID or of the name, like a transcode_encoder.
+		* dec and m must outlive the chunked encoder.
+		* @throws std::runtime_error if the encoder cannot be created, or the workers cannot be started.
+		*/
+		chunked_encoder(const class decoder& dec, const class output_media& m, int ID, const settings& s);
+		chunked_encoder(const class decoder& dec, const class output_media& m, const char* name, const settings& s);
+		// Uses the default settings.
+		chunked_encoder(const class decoder& dec, const class output_media& m, int ID);
+		chunked_encoder(const class decoder& dec, const class output_media& m, const char* name);
+
+		chunked_encoder(const chunked_encoder&) = delete;
+		chunked_encoder& operator=(const chunked_encoder&) = delete;
+
+		// Stops the workers. Packets not taken are lost.
+		~chunked_encoder();
+
+	public:
+		/*
+		* Feeds a frame, whose data is refed rather than copied, to the current chunk. Waits while too many frames are buffered.
+		* @returns true if the frame is fed; false after start_draining().
+		* @throws std::runtime_error if a chunk encoder cannot be created, or a worker failed.
+		*/
+		bool try_feed(ff::frame& f) override;
+
+		/*
+		* Gets the next packet if it's encoded already.
+		* @returns the packet, or an invalid packet if it's not encoded yet, or after the last one (see eof()).
+		* @throws std::runtime_error if a worker failed, or if the dts of a chunk cannot be shifted (see the class)
+		*/
+		ff::packet try_get_one() override;
+
+		/*
+		* Waits for the next packet.
+		* @returns the packet, or an invalid packet after the last one, which only comes after start_draining().
+		* Before start_draining(), only call this while frames are buffered, or fed from another thread.
+		* @throws std::runtime_error if a worker failed, or if the dts of a chunk cannot be shifted (see the class)
+		*/
+		ff::packet wait_and_get_one();
+
+		// Ends the last chunk. No more frames can be fed after this.
+		void start_draining();
+
+		// @returns true iff every packet has been taken after start_draining().
+		bool eof() const;
+
+	public:
+		// @returns the encoder that has the parameters of every chunk encoder, to add the output stream with. It encodes nothing.
+		const encoder& get_stream_encoder() const { return *stream_enc; }
+
+		statistics get_statistics() const;
+
+	private:
+		// The frames of a chunk and the packets encoded from them.
+		struct chunk
+		{
+			std::unique_ptr<encoder> enc;
+
+			std::deque<ff::frame> frames;
+			// true iff no more frames are fed to the chunk
+			bool closed = false;
+			// true iff a worker has taken the chunk
+			bool taken = false;
+
+			std::deque<ff::packet> packets;
+			// true iff the encoder is drained and every packet is put
+			bool done = false;
+
+			// added to the dts of every packet, decided at the first one that has a dts
+			int64_t dts_shift = 0;
+			bool dts_shift_known = false;
+		};
+
+	private:
+		// Creates the stream encoder and starts the workers. Requires: make_enc is set.
+		void start();
+
+		/*
+		* Closes the current chunk and appends a new one with a new encoder, which is created with the mutex unlocked.
+		* Requires: the mutex is locked by lock.
+		*/
+		void open_chunk(std::unique_lock<std::mutex>& lock);
+
+		// The body of each worker.
+		void worker_loop();
+
+		// Encodes c until it's done.
+		void encode_chunk(chunk& c);
+
+		// Receives every packet enc has now into c. @returns the status that stopped it: again(), or eof() after draining.
+		status receive_packets(encoder& enc, chunk& c);
+
+		/*
+		* Takes the next packet out, waiting for it if wait, and shifts its dts after those of the chunk before.
+		* Requires: the mutex is locked by lock.
+		* @throws std::runtime_error if a worker failed, or if the dts cannot be shifted
+		*/
+		ff::packet get_one(std::unique_lock<std::mutex>& lock, bool wait);
+
+		// Rethrows the error of a worker if there is one. Requires: the mutex is locked.
+		void check_error() const;
+
+	private:
+		settings opts;
+		std::function<std::unique_ptr<encoder>()> make_enc;
+		std::unique_ptr<encoder> stream_enc;
+
+		std::vector<std::thread> workers;
+
+		mutable std::mutex mutex;
+		// notified when a chunk is opened or closed, or frames are fed
+		std::condition_variable frame_put;
+		// notified when a worker takes a frame
+		std::condition_variable frame_taken;
+		// notified when a packet is put or a chunk is done
+		std::condition_variable packet_put;
+
+		// The front is the chunk packets are taken from, and the back the one frames are fed to.
+		std::deque<std::unique_ptr<chunk>> chunks;
+		// the frames in the current chunk
+		int current_frames = 0;
+		size_t buffered_frames = 0;
+		bool draining = false;
+		bool stopping = false;
+		std::exception_ptr error;
+
+		int64_t last_dts;
+
+		statistics stats;
+	};
+}
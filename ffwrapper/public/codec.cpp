@@ -8,20 +8,215 @@ extern "C"
 #include "../private/utility/info.h"
 
 #include "codec.h"
+#include "codec_thread_pool.h"
 
 #include <stdexcept>
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+	// libavcodec does not start more threads than this on its own either.
+	constexpr int max_auto_threads = 16;
+
+	// @returns how many threads are worth it for decoding or encoding the video of ctx.
+	int wanted_threads(const AVCodecContext* ctx)
+	{
+		if (ctx->codec_type != AVMEDIA_TYPE_VIDEO)
+		{
+			// Audio codecs have no threading worth the overhead.
+			return 1;
+		}
+
+		int64_t pixels = (int64_t)ctx->width * ctx->height;
+		if (pixels <= 0)
+		{
+			// Unknown yet. Assume HD.
+			pixels = 1920 * 1080;
+		}
+
+		// About one thread per 256K pixels: 2 for SD, 4 for 720p, 8 for 1080p, 16 for 4K.
+		int64_t n = (pixels + 256 * 1024 - 1) / (256 * 1024);
+
+		switch (ctx->codec_id)
+		{
+		case AV_CODEC_ID_HEVC:
+		case AV_CODEC_ID_VP9:
+		case AV_CODEC_ID_AV1:
+			// Twice as much work per pixel as H.264.
+			n *= 2;
+			break;
+		default:
+			break;
+		}
+
+		const AVCodecDescriptor* desc = avcodec_descriptor_get(ctx->codec_id);
+		if (desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY) && (desc->props & AV_CODEC_PROP_LOSSY))
+		{
+			// e.g. MJPEG: cheap frames that do not depend on each other.
+			n = (n + 1) / 2;
+		}
+
+		return (int)std::clamp<int64_t>(n, 1, max_auto_threads);
+	}
+}
+
+ff::codec_thread_budget& ff::codec_thread_budget::instance()
+{
+	static codec_thread_budget budget;
+	return budget;
+}
+
+ff::codec_thread_budget::codec_thread_budget() :
+	total(std::max(1, (int)std::thread::hardware_concurrency()))
+{
+}
+
+int ff::codec_thread_budget::get_total() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return total;
+}
+
+void ff::codec_thread_budget::set_total(int n)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	total = n > 0 ? n : std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+int ff::codec_thread_budget::get_in_use() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return in_use;
+}
+
+int ff::codec_thread_budget::acquire(int wanted)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	int n = std::max(1, std::min(wanted, total - in_use));
+	in_use += n;
+	return n;
+}
+
+void ff::codec_thread_budget::release(int n)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	in_use = std::max(0, in_use - n);
+}
 
 void ff::codec_base::create()
 {
+	// The pool is only created for codecs that use it.
+	bool pooled = use_shared_pool || (codec_thread_pool::is_used_for_all() && codec_ctx->thread_count == 1);
+	if (pooled)
+	{
+		codec_thread_pool::instance().prepare(codec_ctx);
+	}
+
 	if (avcodec_open2(codec_ctx, codec, NULL) < 0)
 	{
 		ON_FF_ERROR("Failed to init the decoder.")
 	}
+
+	if (pooled)
+	{
+		codec_thread_pool::instance().install(codec_ctx);
+	}
 }
 
 void ff::codec_base::destroy()
 {
 	ffhelpers::safely_free_codec_context(&codec_ctx);
+
+	if (budgeted_threads > 0)
+	{
+		codec_thread_budget::instance().release(budgeted_threads);
+		budgeted_threads = 0;
+	}
+}
+
+void ff::codec_base::configure_threading(const threading_options& opts)
+{
+	if (budgeted_threads > 0)
+	{
+		// Configured again: what was reserved before is given back first.
+		codec_thread_budget::instance().release(budgeted_threads);
+		budgeted_threads = 0;
+	}
+
+	int count = opts.thread_count;
+	thread_type type = opts.type;
+
+	// The pool decides the threads when the codec is created.
+	use_shared_pool = opts.shared_pool;
+	if (use_shared_pool)
+	{
+		count = 1;
+	}
+	else if (opts.automatic)
+	{
+		int caps = codec ? codec->capabilities : 0;
+		bool can_frame = (caps & AV_CODEC_CAP_FRAME_THREADS) && !opts.low_delay;
+		bool can_slice = (caps & AV_CODEC_CAP_SLICE_THREADS) != 0;
+
+		if (can_frame || can_slice)
+		{
+			budgeted_threads = codec_thread_budget::instance().acquire(wanted_threads(codec_ctx));
+			count = budgeted_threads;
+			type = can_frame ? thread_type::frame : thread_type::slice;
+		}
+		else
+		{
+			count = 1;
+		}
+	}
+
+	if (opts.low_delay && type != thread_type::slice && count != 1)
+	{
+		// Frame threading holds back a frame per thread.
+		type = thread_type::slice;
+	}
+
+	codec_ctx->thread_count = std::max(count, 0);
+	switch (type)
+	{
+	case thread_type::frame:
+		codec_ctx->thread_type = FF_THREAD_FRAME;
+		break;
+	case thread_type::slice:
+		codec_ctx->thread_type = FF_THREAD_SLICE;
+		break;
+	default:
+		codec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+		break;
+	}
+
+	if (opts.low_delay)
+	{
+		codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+	}
+}
+
+int ff::codec_base::get_thread_count() const
+{
+	return codec_ctx ? codec_ctx->thread_count : 0;
+}
+
+ff::thread_type ff::codec_base::get_active_thread_type() const
+{
+	if (codec_ctx)
+	{
+		if (codec_ctx->active_thread_type & FF_THREAD_FRAME)
+		{
+			return thread_type::frame;
+		}
+		if (codec_ctx->active_thread_type & FF_THREAD_SLICE)
+		{
+			return thread_type::slice;
+		}
+	}
+
+	return thread_type::any;
 }
 
 void ff::codec_base::flush_codec()
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <mutex>
+
 struct AVRational;
 struct AVCodec;
 struct AVCodecContext;
@@ -12,6 +14,83 @@ struct AVChannelLayout;
 
 namespace ff
 {
+	// How a codec spreads its work over threads.
+	enum class thread_type
+	{
+		// Frame threading if the codec supports it, slice threading otherwise. The default of libavcodec.
+		any,
+		// Several frames are decoded at once. Scales well, but delays the output by a frame per thread.
+		frame,
+		// Each frame is split into slices. No delay, but it only helps streams encoded with several slices per frame.
+		slice
+	};
+
+	/*
+	* Threading settings of a codec, which must be decided before it's opened.
+	* The defaults are those of libavcodec, i.e. no threading at all.
+	*/
+	struct threading_options
+	{
+		/*
+		* Chooses the number and the type of the threads from the resolution, the codec, and what is left of
+		 the process-wide codec_thread_budget. thread_count and type are ignored then.
+		*/
+		bool automatic = false;
+
+		// The number of threads. 0 for one per core, 1 for no threading.
+		int thread_count = 1;
+		thread_type type = thread_type::any;
+
+		// Outputs each frame as soon as it can be, for previews and scrubbing. Rules out frame threading.
+		bool low_delay = false;
+
+		/*
+		* Runs the slice jobs of the codec on the codec_thread_pool of the process instead of threads of its own.
+		 libavcodec still keeps parked slice threads for the codec, so this bounds the CPU use, not the number of threads.
+		* The codec is opened with slice threading, and the other fields are ignored except low_delay.
+		*/
+		bool shared_pool = false;
+	};
+
+	/*
+	* The number of threads that the codecs of the process with threading_options::automatic may use together,
+	 so that many concurrent decoders share the cores instead of each taking all of them.
+	* Each such codec reserves its threads when it's configured and gives them back when it's destroyed.
+	* All methods are synchronized.
+	*/
+	class codec_thread_budget
+	{
+	public:
+		// @returns the budget of the process.
+		static codec_thread_budget& instance();
+
+		codec_thread_budget(const codec_thread_budget&) = delete;
+		codec_thread_budget& operator=(const codec_thread_budget&) = delete;
+
+	public:
+		int get_total() const;
+		// Sets the total number of threads. 0 for the number of cores. Codecs already configured keep their threads.
+		void set_total(int n);
+		// @returns the number of threads reserved by the codecs alive.
+		int get_in_use() const;
+
+		/*
+		* Reserves at most wanted threads.
+		* @returns the number reserved, which is at least 1 even if the budget is used up, as a codec needs a thread anyway.
+		*/
+		int acquire(int wanted);
+		// Gives back n threads reserved by acquire().
+		void release(int n);
+
+	private:
+		codec_thread_budget();
+
+	private:
+		mutable std::mutex mutex;
+		int total;
+		int in_use = 0;
+	};
+
 	class codec_base
 	{
 	public:
@@ -24,14 +103,21 @@ namespace ff
 		* Requires that codec and codec_ctx are initialized.
 		* Requires additionally that codec_ctx has been filled with necessary information.
 		* 
-		* Creates the codec by calling avcodec_open2.
+		* Creates the codec by calling avcodec_open2, and routes its slice jobs to the codec_thread_pool
+		 if it's configured so, or if the pool is used for all codecs and the threading is left at the default.
 		* Throws std::runtime_error on error.
 		*/
 		virtual void create();
 
-		// Destroys the codec ctx, but not the codec.
+		// Destroys the codec ctx, but not the codec, and gives back the threads reserved from the codec_thread_budget.
 		virtual void destroy();
 
+		/*
+		* Configures how the codec uses threads. Requires that the codec is not created yet.
+		* Automatic settings need the resolution, so fill in the codec context first.
+		*/
+		void configure_threading(const threading_options& opts);
+
 		/*
 		* Flushes the codec.
 		* Can be used when, for example, draining is needed, or when a seeking is done.
@@ -74,6 +160,14 @@ namespace ff
 		// @returns true iff the codec is ready for encoding/decoding
 		virtual bool ready() const { return codec_ctx != nullptr; }
 
+		// @returns the number of threads the codec uses, which is only final once it's created.
+		int get_thread_count() const;
+		/*
+		* @returns the type of threading the codec actually uses once it's created, or thread_type::any
+		 if it uses none, e.g. because it supports neither type.
+		*/
+		thread_type get_active_thread_type() const;
+
 	protected:
 		/*
 		* Configures multithreading settings for the codec.
@@ -85,5 +179,10 @@ namespace ff
 	protected:
 		const ::AVCodec* codec = nullptr;
 		::AVCodecContext* codec_ctx = nullptr;
+
+		// the threads reserved from the codec_thread_budget
+		int budgeted_threads = 0;
+		// true iff configured with threading_options::shared_pool
+		bool use_shared_pool = false;
 	};
 }
@@ -0,0 +1,276 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include "codec_thread_pool.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <system_error>
+
+namespace
+{
+	// The most slices a codec is asked to split its work into, as with automatic threading in libavcodec.
+	constexpr int max_slices = 16;
+}
+
+struct ff::codec_thread_pool::batch
+{
+	::AVCodecContext* ctx = nullptr;
+	// One of them is set.
+	int (*func)(::AVCodecContext*, void*) = nullptr;
+	int (*func2)(::AVCodecContext*, void*, int, int) = nullptr;
+	void* arg = nullptr;
+	// the size of the argument of each job for func, which are consecutive
+	int size = 0;
+	int* ret = nullptr;
+	int count = 0;
+
+	// Codecs index per-thread scratch space with the thread index, which must stay below their thread_count.
+	int max_threads = 1;
+
+	// The next job to claim. Jobs are claimed in order, so that a job waiting for the previous ones
+	// (e.g. wavefronts in HEVC) never waits for one that has not started.
+	std::atomic<int> next_job{ 0 };
+	std::atomic<int> num_done{ 0 };
+
+	// Guarded by the mutex of the pool.
+	// the next thread index to hand out. 0 is the calling thread.
+	int next_thread = 1;
+	// the number of workers running jobs of the batch
+	int num_workers = 0;
+};
+
+ff::codec_thread_pool& ff::codec_thread_pool::instance()
+{
+	static codec_thread_pool pool;
+	return pool;
+}
+
+std::atomic<bool> ff::codec_thread_pool::used_for_all{ false };
+
+ff::codec_thread_pool::codec_thread_pool()
+{
+	// The workers start on the first prepare(), so a process that never uses the pool has no idle threads.
+}
+
+ff::codec_thread_pool::~codec_thread_pool()
+{
+	stop_workers();
+}
+
+int ff::codec_thread_pool::get_num_threads() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (int)workers.size();
+}
+
+void ff::codec_thread_pool::set_num_threads(int n)
+{
+	stop_workers();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	wanted_threads = n;
+	if (started)
+	{
+		start_workers(n);
+	}
+}
+
+ff::codec_thread_pool::statistics ff::codec_thread_pool::get_statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void ff::codec_thread_pool::start_workers(int n)
+{
+	if (n <= 0)
+	{
+		n = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	stopping = false;
+	try
+	{
+		for (int i = 0; i != n; ++i)
+		{
+			workers.emplace_back(&codec_thread_pool::worker_loop, this);
+		}
+	}
+	catch (const std::system_error& e)
+	{
+		// Fewer workers still work, as the calling threads run their own jobs.
+		if (workers.empty())
+		{
+			ON_FF_ERROR(std::string("Could not start the threads of the codec thread pool. ") + e.what())
+		}
+	}
+	started = true;
+}
+
+void ff::codec_thread_pool::stop_workers()
+{
+	std::vector<std::thread> stopped;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		stopped.swap(workers);
+	}
+	has_work.notify_all();
+
+	for (auto& t : stopped)
+	{
+		t.join();
+	}
+}
+
+void ff::codec_thread_pool::prepare(::AVCodecContext* ctx)
+{
+	if (!ctx->codec || !(ctx->codec->capabilities & AV_CODEC_CAP_SLICE_THREADS))
+	{
+		return;
+	}
+
+	int num_workers = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!started)
+		{
+			start_workers(wanted_threads);
+		}
+		num_workers = (int)workers.size();
+	}
+
+	// The workers and the calling thread.
+	ctx->thread_count = std::min(num_workers + 1, max_slices);
+	ctx->thread_type = FF_THREAD_SLICE;
+}
+
+void ff::codec_thread_pool::install(::AVCodecContext* ctx)
+{
+	if (!(ctx->active_thread_type & FF_THREAD_SLICE))
+	{
+		return;
+	}
+
+	ctx->execute = &codec_thread_pool::execute;
+	ctx->execute2 = &codec_thread_pool::execute2;
+}
+
+int ff::codec_thread_pool::execute(::AVCodecContext* ctx, int (*func)(::AVCodecContext*, void*), void* arg, int* ret, int count, int size)
+{
+	batch b;
+	b.ctx = ctx;
+	b.func = func;
+	b.arg = arg;
+	b.size = size;
+	b.ret = ret;
+	b.count = count;
+	b.max_threads = std::max(ctx->thread_count, 1);
+
+	instance().run(b);
+	return 0;
+}
+
+int ff::codec_thread_pool::execute2(::AVCodecContext* ctx, int (*func)(::AVCodecContext*, void*, int, int), void* arg, int* ret, int count)
+{
+	batch b;
+	b.ctx = ctx;
+	b.func2 = func;
+	b.arg = arg;
+	b.ret = ret;
+	b.count = count;
+	b.max_threads = std::max(ctx->thread_count, 1);
+
+	instance().run(b);
+	return 0;
+}
+
+int ff::codec_thread_pool::run_jobs(batch& b, int thread_index)
+{
+	int num_run = 0;
+	int job;
+	while ((job = b.next_job.fetch_add(1)) < b.count)
+	{
+		int r = b.func2 ?
+			b.func2(b.ctx, b.arg, job, thread_index) :
+			b.func(b.ctx, (char*)b.arg + (size_t)job * b.size);
+		if (b.ret)
+		{
+			b.ret[job] = r;
+		}
+		++num_run;
+		b.num_done.fetch_add(1);
+	}
+	return num_run;
+}
+
+void ff::codec_thread_pool::run(batch& b)
+{
+	bool shared = b.count > 1 && b.max_threads > 1;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++stats.num_calls;
+		stats.num_jobs += b.count;
+		if (shared)
+		{
+			queue.push_back(&b);
+		}
+	}
+	if (shared)
+	{
+		has_work.notify_all();
+	}
+
+	run_jobs(b, 0);
+
+	if (shared)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto it = std::find(queue.begin(), queue.end(), &b);
+		if (it != queue.end())
+		{
+			queue.erase(it);
+		}
+		// The workers must be done with b before it goes out of scope.
+		batch_done.wait(lock, [&b]() { return b.num_done == b.count && b.num_workers == 0; });
+	}
+}
+
+void ff::codec_thread_pool::worker_loop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		has_work.wait(lock, [this]() { return stopping || !queue.empty(); });
+		if (stopping)
+		{
+			return;
+		}
+
+		batch* b = queue.front();
+		if (b->next_thread >= b->max_threads || b->next_job >= b->count)
+		{
+			// Nothing for another thread to do. Its calling thread is waiting for the jobs claimed already.
+			queue.pop_front();
+			continue;
+		}
+
+		int thread_index = b->next_thread++;
+		++b->num_workers;
+
+		lock.unlock();
+		int num_run = run_jobs(*b, thread_index);
+		lock.lock();
+
+		stats.num_jobs_by_workers += num_run;
+		--b->num_workers;
+		if (b->num_done == b->count && b->num_workers == 0)
+		{
+			batch_done.notify_all();
+		}
+	}
+}
@@ -0,0 +1,131 @@
+/*
+* codec_thread_pool.h:
+* Defines a process-wide pool of threads that runs the slice jobs of codecs.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct AVCodecContext;
+
+namespace ff
+{
+	/*
+	* Runs the jobs that codecs with slice threading hand to AVCodecContext::execute() and execute2(),
+	 so that many codecs working at once share the CPU time of one set of workers instead of each keeping the cores busy with its own.
+	*
+	* A codec uses the pool if it's configured with threading_options::shared_pool, or if set_used_for_all()
+	 is on and its threading is left at the default of none. It's then opened with slice threading,
+	 and the callbacks are replaced once it's open. The pool is not created, and its workers are not started,
+	 until the first such codec is prepared.
+	* The calls in flight are kept in one FIFO queue, and idle workers claim the jobs of the oldest call one at a time.
+	 There's no work stealing. The calling thread works on its own jobs too, so a call finishes even when every worker is busy.
+	*
+	* Only the CPU use is shared, not the number of threads: libavcodec still starts its own slice threads for each
+	 codec opened with more than one thread. They stay parked, except for the few codecs that drive them directly
+	 (e.g. VP9 tiles), but they exist until the codec is closed. Codecs without slice threading are not affected.
+	* Frame threading cannot go through the pool; use the codec_thread_budget for that.
+	*
+	* All methods are synchronized.
+	*/
+	class codec_thread_pool
+	{
+	public:
+		struct statistics
+		{
+			// the number of calls to execute() and execute2()
+			uint64_t num_calls = 0;
+			uint64_t num_jobs = 0;
+			// the number of jobs run by the workers instead of by the calling threads
+			uint64_t num_jobs_by_workers = 0;
+		};
+
+	public:
+		// @returns the pool of the process. Its workers start when the first codec is prepared for it.
+		static codec_thread_pool& instance();
+
+		codec_thread_pool(const codec_thread_pool&) = delete;
+		codec_thread_pool& operator=(const codec_thread_pool&) = delete;
+
+		// Stops the workers.
+		~codec_thread_pool();
+
+	public:
+		// @returns the number of workers, which is 0 until they start.
+		int get_num_threads() const;
+		/*
+		* Sets the number of workers to n, 0 for one per core, and restarts them if they have started.
+		* Calls in flight are finished by their calling threads, so it's safe while codecs are working.
+		* @throws std::runtime_error if the threads cannot be started
+		*/
+		void set_num_threads(int n);
+
+		/*
+		* Makes every codec created from now on whose threading is left at the default use the pool.
+		* Static, so that codecs can check it without creating the pool.
+		*/
+		static void set_used_for_all(bool on) { used_for_all = on; }
+		static bool is_used_for_all() { return used_for_all; }
+
+		statistics get_statistics() const;
+
+	public:
+		/*
+		* Configures the codec context of a codec that has not been opened yet to split its work into slices for the pool.
+		* Does nothing to codecs without slice threading, which may run threads of their own (e.g. libx264).
+		* Starts the workers on the first call.
+		* @throws std::runtime_error if the workers cannot be started
+		*/
+		void prepare(::AVCodecContext* ctx);
+
+		/*
+		* Routes the slice jobs of the opened codec context to the pool.
+		* Does nothing if the codec did not turn on slice threading.
+		*/
+		void install(::AVCodecContext* ctx);
+
+	private:
+		codec_thread_pool();
+
+		// The jobs of one call to execute() or execute2().
+		struct batch;
+
+		// Callbacks of AVCodecContext.
+		static int execute(::AVCodecContext* ctx, int (*func)(::AVCodecContext*, void*), void* arg, int* ret, int count, int size);
+		static int execute2(::AVCodecContext* ctx, int (*func)(::AVCodecContext*, void*, int, int), void* arg, int* ret, int count);
+
+		// Runs b with the calling thread and whichever workers are free, and returns once all jobs are done.
+		void run(batch& b);
+
+		// Runs jobs of b until there is none left to claim. @returns the number of jobs run.
+		static int run_jobs(batch& b, int thread_index);
+
+		// Requires: the mutex is locked.
+		void start_workers(int n);
+		void stop_workers();
+		void worker_loop();
+
+	private:
+		mutable std::mutex mutex;
+		std::condition_variable has_work, batch_done;
+		// Batches with jobs not claimed yet. The calling threads remove their own.
+		std::deque<batch*> queue;
+		std::vector<std::thread> workers;
+		bool stopping = false;
+		// true once the workers have been started, so that set_num_threads() restarts them
+		bool started = false;
+		// the number of workers to start. 0 for one per core.
+		int wanted_threads = 0;
+
+		static std::atomic<bool> used_for_all;
+
+		statistics stats;
+	};
+}
@@ -2,6 +2,7 @@ extern "C"
 {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
 }
 
 #include "../private/ff_helpers.h"
@@ -10,8 +11,56 @@ extern "C"
 #include "decoder.h"
 #include "demuxer.h"
 #include "frame.h"
+#include "packet_pool.h"
+
+extern "C"
+{
+#include <libswscale/swscale.h>
+}
 
 #include <stdexcept>
+#include <new>
+#include <utility>
+
+namespace
+{
+    // The get_format callback of input decoders. ctx->opaque is the decoder.
+    AVPixelFormat choose_pixel_format(AVCodecContext* ctx, const AVPixelFormat* offered)
+    {
+        auto* dec = static_cast<const ff::input_decoder*>(ctx->opaque);
+
+        // The format the decoder has output so far, which encoders may have been created for already.
+        // Also asked again when the stream is reinitialized, which must not switch formats under them.
+        std::vector<int> preferences;
+        int current = dec->get_output_video_info().pix_fmt;
+        if (current != AV_PIX_FMT_NONE)
+        {
+            preferences.push_back(current);
+        }
+        const auto& preferred_pixel_formats = dec->get_options().preferred_pixel_formats;
+        preferences.insert(preferences.end(), preferred_pixel_formats.begin(), preferred_pixel_formats.end());
+
+        for (int preferred : preferences)
+        {
+            // A hardware format needs a device the decoder does not have.
+            const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)preferred);
+            if (!desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+            {
+                continue;
+            }
+
+            for (const AVPixelFormat* p = offered; *p != AV_PIX_FMT_NONE; ++p)
+            {
+                if (*p == preferred)
+                {
+                    return *p;
+                }
+            }
+        }
+
+        return avcodec_default_get_format(ctx, offered);
+    }
+}
 
 ff::decoder::decoder(int ID)
 {
@@ -47,46 +96,85 @@ ff::decoder::decoder(const char* name)
 
 bool ff::decoder::try_feed(ff::packet& pkt)
 {
-    int ret = avcodec_send_packet(codec_ctx, pkt);
+    status st = feed(pkt);
 
-    if (ret < 0)
+    if (st.is_error())
     {
-        switch (ret)
+        ON_FF_ERROR_WITH_CODE("Could not feed a packet to the decoder.", st.code);
+    }
+
+    return st.ok();
+}
+
+ff::status ff::decoder::feed(ff::packet& pkt) noexcept
+{
+    // libavcodec would parse it only to skip it.
+    if (skip.frame == skip_level::nonkey && pkt.is_valid() && !(pkt->flags & AV_PKT_FLAG_KEY))
+    {
+        if (pkt_pool)
         {
-        case AVERROR_EOF: 
-            // Intentionally no break.
-        case AVERROR(EAGAIN):
-            return false;
-        default:
-            ON_FF_ERROR_WITH_CODE("Could not feed a packet to the decoder.", ret);
+            pkt_pool->release(pkt);
         }
+        return status::success();
     }
 
-    return true;
+    status st(avcodec_send_packet(codec_ctx, pkt));
+
+    if (st.ok() && pkt_pool)
+    {
+        pkt_pool->release(pkt);
+    }
+
+    return st;
 }
 
 ff::frame ff::decoder::try_get_one()
 {
     ff::frame f;
-    int ret = avcodec_receive_frame(codec_ctx, f);
-
-    if (ret >= 0) // we got the frame we want
+    if (try_get_one(f))
     {
         return f;
     }
-    else
+
+    return ff::frame(nullptr);
+}
+
+bool ff::decoder::try_get_one(ff::frame& reuse)
+{
+    status st = receive(reuse);
+
+    if (st.is_error())
     {
-        switch (ret)
+        ON_FF_ERROR_WITH_CODE("Could not decode a frame.", st.code);
+    }
+
+    return st.ok();
+}
+
+ff::status ff::decoder::receive(ff::frame& reuse) noexcept
+{
+    if (!reuse.is_valid())
+    {
+        reuse.buffer = av_frame_alloc();
+        if (!reuse.buffer)
         {
-        case AVERROR_EOF:
-            eof_reached = true;
-            // Intentionally no break.
-        case AVERROR(EAGAIN):
-            return ff::frame(nullptr);
-        default:
-            ON_FF_ERROR_WITH_CODE("Could not decode a frame.", ret);
-        }       
+            return status(AVERROR(ENOMEM));
+        }
     }
+
+    // avcodec_receive_frame() unrefs whatever reuse held.
+    status st(avcodec_receive_frame(codec_ctx, reuse));
+
+    if (st.eof())
+    {
+        eof_reached = true;
+    }
+    else if (st.ok())
+    {
+        st = finish_frame(reuse);
+    }
+
+    return st;
 }
 
 void ff::decoder::flush_codec()
@@ -96,6 +184,52 @@ void ff::decoder::flush_codec()
     eof_reached = false;
 }
 
+namespace
+{
+    ::AVDiscard to_av_discard(ff::skip_level level)
+    {
+        switch (level)
+        {
+        case ff::skip_level::nonref:
+            return AVDISCARD_NONREF;
+        case ff::skip_level::bidir:
+            return AVDISCARD_BIDIR;
+        case ff::skip_level::nonintra:
+            return AVDISCARD_NONINTRA;
+        case ff::skip_level::nonkey:
+            return AVDISCARD_NONKEY;
+        case ff::skip_level::all:
+            return AVDISCARD_ALL;
+        default:
+            return AVDISCARD_DEFAULT;
+        }
+    }
+}
+
+void ff::decoder::set_skip(const skip_options& opts)
+{
+    skip = opts;
+
+    // Frame threads copy these from the context with each packet.
+    codec_ctx->skip_frame = to_av_discard(opts.frame);
+    codec_ctx->skip_loop_filter = to_av_discard(opts.loop_filter);
+    codec_ctx->skip_idct = to_av_discard(opts.idct);
+}
+
+void ff::decoder::set_keyframes_only(bool on)
+{
+    skip_options opts;
+    opts.frame = on ? skip_level::nonkey : skip_level::none;
+    set_skip(opts);
+}
+
+ff::video_info ff::decoder::get_output_video_info() const
+{
+    video_info info;
+    get_current_video_info(info);
+    return info;
+}
+
 void ff::decoder::start_draining()
 {
     int ret = avcodec_send_packet(codec_ctx, nullptr);
@@ -105,24 +239,158 @@ void ff::decoder::start_draining()
     }
 }
 
-ff::input_decoder::input_decoder(const demuxer_port& port) : input_decoder(port.stream.p_stream) {}
+ff::input_decoder::input_decoder(const demuxer_port& port, const decoder_options& opts) : 
+    input_decoder(port.stream.p_stream, opts) {}
+
+ff::input_decoder::input_decoder(const::AVStream* st, const decoder_options& opts) : decoder(st->codecpar->codec_id)
+{
+    // The destructor does not run if the constructor throws, and the context and the reserved threads must go.
+    try
+    {
+        /* Copy codec parameters from input stream to output codec context */
+        if (avcodec_parameters_to_context(codec_ctx, st->codecpar) < 0)
+        {
+            ON_FF_ERROR("Failed to copy decoder parameters from the stream to decoder context.")
+        }
+
+        // time_base is deprecated for decoding.
+        // But we still set it for reference
+        codec_ctx->time_base = st->time_base;
+        // Instead, set the frame rate
+        codec_ctx->framerate = st->r_frame_rate;
+
+        // Kept to tell which streams the decoder can be reused for.
+        options = opts;
+        stream_params.reset(avcodec_parameters_alloc(), [](AVCodecParameters* p) { avcodec_parameters_free(&p); });
+        if (!stream_params || avcodec_parameters_copy(stream_params.get(), st->codecpar) < 0)
+        {
+            ON_FF_ERROR("Failed to copy the codec parameters of the stream.")
+        }
+
+        // The resolution and the codec are known now, which automatic threading needs.
+        configure_threading(opts.threading);
+
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            scale_shift = (int)opts.scale;
+            if (scale_shift > 0 && codec->max_lowres >= scale_shift)
+            {
+                codec_ctx->lowres = scale_shift;
+                scaled_by_codec = true;
+            }
+
+            // The same rounding as lowres.
+            output_info = video_info
+            (
+                st->codecpar->format,
+                (st->codecpar->width + (1 << scale_shift) - 1) >> scale_shift,
+                (st->codecpar->height + (1 << scale_shift) - 1) >> scale_shift
+            );
+        }
+
+        // get_buffer2 and get_format must be installed before the codec is opened. Both reach the decoder through opaque.
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            // The arena is sized before decoding, so it needs the format and the size from the container.
+            video_info arena_info(st->codecpar->format, st->codecpar->width, st->codecpar->height);
+            if (opts.use_buffer_arena && arena_info.valid() && arena_info.width > 0 && arena_info.height > 0)
+            {
+                buffer_arena.reset(new frame_buffer_arena(codec_ctx, arena_info, opts.arena_settings));
+
+                if (buffer_arena->install(codec_ctx))
+                {
+                    codec_ctx->get_buffer2 = get_buffer2;
+                }
+                else
+                {
+                    buffer_arena.reset();
+                }
+            }
+
+            if (!opts.preferred_pixel_formats.empty())
+            {
+                codec_ctx->get_format = choose_pixel_format;
+            }
+
+            codec_ctx->opaque = this;
+        }
+
+        create();
+    }
+    catch (...)
+    {
+        destroy();
+        throw;
+    }
+}
 
-ff::input_decoder::input_decoder(const::AVStream* st) : decoder(st->codecpar->codec_id)
+ff::status ff::input_decoder::finish_frame(ff::frame& f) noexcept
 {
-    /* Copy codec parameters from input stream to output codec context */
-    if (avcodec_parameters_to_context(codec_ctx, st->codecpar) < 0)
+    if (codec->type != AVMEDIA_TYPE_VIDEO)
+    {
+        return status::success();
+    }
+    if (scale_shift == 0 || scaled_by_codec)
     {
-        ON_FF_ERROR("Failed to copy decoder parameters from the stream to decoder context.")
+        // Follows what get_format chose, or a change of size in the stream.
+        output_info = video_info(f->format, f->width, f->height);
+        return status::success();
     }
 
-    // time_base is deprecated for decoding.
-    // But we still set it for reference
-    codec_ctx->time_base = st->time_base;
-    // Instead, set the frame rate
-    codec_ctx->framerate = st->r_frame_rate;
+    try
+    {
+        video_info src(f->format, f->width, f->height);
+        video_info dst
+        (
+            f->format,
+            (f->width + (1 << scale_shift) - 1) >> scale_shift,
+            (f->height + (1 << scale_shift) - 1) >> scale_shift
+        );
 
-    // for debug purposes only
-    //configure_multithreading(16);
+        if (!downscaler || src != downscaler_src)
+        {
+            // Frames of the old pool the caller still holds stay valid: their shells are their own,
+            // and their planes go back to AVBufferPools that are only freed once the last plane is unrefed.
+            // Area averaging keeps thumbnails from aliasing at large factors.
+            downscaler.reset(new image_converter(src.width, src.height, src.pix_fmt, dst.width, dst.height, dst.pix_fmt, SWS_AREA));
+            scaled_frames.reset(new frame_pool(dst));
+            downscaler_src = src;
+            output_info = dst;
+        }
 
-    create();
+        ff::frame scaled = scaled_frames->acquire();
+        downscaler->convert(f, scaled);
+
+        int err = av_frame_copy_props(scaled, f);
+        if (err < 0)
+        {
+            return status(err);
+        }
+
+        // f keeps the pooled shell, which now holds the small planes, and the caller's shell goes into the pool.
+        // Unrefing it there gives the full-size planes back to the codec.
+        std::swap(f.buffer, scaled.buffer);
+        scaled_frames->release(scaled);
+        return status::success();
+    }
+    catch (const std::bad_alloc&)
+    {
+        return status(AVERROR(ENOMEM));
+    }
+    catch (const std::exception&)
+    {
+        // The converter and the pool only throw on failures they cannot tell the code of.
+        return status(AVERROR(EINVAL));
+    }
+}
+
+int ff::input_decoder::get_buffer2(::AVCodecContext* ctx, ::AVFrame* frame, int flags)
+{
+    return static_cast<input_decoder*>(ctx->opaque)->buffer_arena->get_buffer(ctx, frame, flags);
+}
+
+void ff::input_decoder::rebind(const ::AVStream* st)
+{
+    codec_ctx->time_base = st->time_base;
+    codec_ctx->framerate = st->r_frame_rate;
 }
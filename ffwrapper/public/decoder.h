@@ -8,15 +8,59 @@
 #include "codec.h"
 #include "media.h"
 #include "ff_time.h"
+#include "frame_buffer_arena.h"
+#include "status.h"
+#include "image_converter.h"
+#include "frame_pool.h"
+
+#include <memory>
+#include <vector>
 
 struct AVCodec;
 struct AVCodecContext;
+struct AVCodecParameters;
 struct AVStream;
+struct AVFrame;
 
 #include "interfaces/src_sink.h"
 
 namespace ff
 {
+	/*
+	* For which frames libavcodec may skip a step of decoding. Each level includes the frames of the levels before it.
+	*/
+	enum class skip_level
+	{
+		// Skips nothing.
+		none,
+		// Non-reference frames, which no other frame depends on.
+		nonref,
+		// Bidirectional frames (B-frames).
+		bidir,
+		// Everything but intra frames.
+		nonintra,
+		// Everything but keyframes.
+		nonkey,
+		// Every frame.
+		all
+	};
+
+	/*
+	* The work a decoder skips. See decoder::set_skip().
+	*/
+	struct skip_options
+	{
+		/*
+		* The frames not decoded at all. No frame is output for them.
+		* nonkey decodes keyframes only, and nonref drops the frames nothing depends on (e.g. most B-frames).
+		*/
+		skip_level frame = skip_level::none;
+		// The frames decoded without the deblocking filter, which is faster but blockier.
+		skip_level loop_filter = skip_level::none;
+		// The frames decoded without the inverse transform, which is faster but only gives a rough picture.
+		skip_level idct = skip_level::none;
+	};
+
 	/*
 	* Base class for all decoders
 	*/
@@ -39,7 +83,9 @@ namespace ff
 		* Feeds a packet to the decoder for decoding.
 		* 
 		* @param pkt: the packet to feed. Its ownership will not be taken and its content will be copied.
-		* Therefore it's necessary for the caller to destroy it after calling the method.
+		* Therefore the caller still owns it and should unref or destroy it after calling the method.
+		* If a packet pool is set, then a successfully fed packet is given back to the pool instead and becomes invalid.
+		 Unrefing or destroying it then does nothing, so the same code works with and without a pool.
 		* 
 		* @returns true if the packet is successfully fed;
 		* false if no more packets can be fed until some decoded frames are retrieved, 
@@ -49,6 +95,13 @@ namespace ff
 		*/
 		bool try_feed(ff::packet& pkt) override;
 
+		/*
+		* The non-throwing version of try_feed().
+		* @returns ok() if the packet is fed; again() if frames must be retrieved first; eof() if the decoder is draining;
+		* is_error() on failure.
+		*/
+		status feed(ff::packet& pkt) noexcept;
+
 		/*
 		* Tries to decode the next frame.
 		*
@@ -58,6 +111,26 @@ namespace ff
 		*/
 		ff::frame try_get_one() override;
 
+		/*
+		* The same as try_get_one(), but decodes into reuse instead of a new frame
+		 so that the AVFrame is recycled. Whatever reuse held before is unrefed.
+		* If reuse is invalid, then it will be allocated.
+		*
+		* With this, the decoder makes no heap allocations in steady state as libavcodec pools the planes itself.
+		*
+		* @returns true if the decoding succeeds and reuse holds the frame;
+		* false if more packets are needed, or if EOF is reached.
+		* The caller should check eof() to ascertain if EOF is reached.
+		*/
+		bool try_get_one(ff::frame& reuse);
+
+		/*
+		* The non-throwing version of try_get_one(ff::frame&).
+		* @returns ok() if reuse holds a decoded frame; again() if more packets are needed; 
+		* eof() if all frames are out (eof() of the decoder becomes true); is_error() on failure.
+		*/
+		status receive(ff::frame& reuse) noexcept;
+
 		/*
 		* Flushes the decoder and resets its eof state.
 		* Can be called after a draining is complete so that the decoder can be reused, or after a seeking is done.
@@ -76,8 +149,93 @@ namespace ff
 		// is eof reached in draining.
 		bool eof() const { return eof_reached; }
 
+		/*
+		* Makes the decoder skip work from the next packet on, e.g. to decode only the keyframes while scrubbing or scanning.
+		* Can be switched at any time, even while decoding with threads.
+		* 
+		* With skip_options::frame at nonkey, packets that are not keyframes are dropped by feed() before they reach libavcodec.
+		* To scan a whole file, also set the demuxer port to discard_mode::nonkey, so that they are not even read.
+		* 
+		* Frames decoded after going back to less skipping may refer to frames that were skipped,
+		 so switch before a seek, or expect artifacts until the next keyframe.
+		*/
+		void set_skip(const skip_options& opts);
+		const skip_options& get_skip() const { return skip; }
+
+		// Shorthand for set_skip() with only skip_options::frame at nonkey, or with nothing skipped.
+		void set_keyframes_only(bool on);
+		bool is_keyframes_only() const { return skip.frame == skip_level::nonkey; }
+
+		/*
+		* Makes the decoder give the packets fed to it back to pool so that their producers can reuse them.
+		* The pool is not owned by the decoder and must outlive it, or be unset by passing nullptr.
+		*/
+		void set_packet_pool(class packet_pool* pool) { pkt_pool = pool; }
+
+		// @returns the format and the size of the video frames the decoder outputs. Invalid for other streams.
+		virtual video_info get_output_video_info() const;
+
+	protected:
+		/*
+		* Called by receive() on each decoded frame before it's returned, so that derived decoders can process it in place.
+		* @returns ok(), or the error to return instead of the frame.
+		*/
+		virtual status finish_frame(ff::frame& f) noexcept { return status::success(); }
+
 	protected:
 		bool eof_reached = false;
+
+		// Does not own this.
+		class packet_pool* pkt_pool = nullptr;
+
+		skip_options skip;
+	};
+
+	// The resolution video frames are decoded at, relative to that of the stream.
+	enum class resolution_scale
+	{
+		full,
+		half,
+		quarter,
+		eighth
+	};
+
+	/*
+	* Settings of an input_decoder that must be decided before the codec is opened.
+	*/
+	struct decoder_options
+	{
+		/*
+		* If true, video frames are decoded into a frame_buffer_arena sized from the stream's video_info,
+		* instead of into buffers from libavcodec's default allocator.
+		* Ignored for other streams, if the codec does not support custom buffers, or if the container does not tell
+		 the pixel format and the size of the stream, which the arena is sized from. The default allocator is used then.
+		*/
+		bool use_buffer_arena = false;
+		frame_buffer_arena::settings arena_settings;
+
+		// How the decoder uses threads. See threading_options.
+		threading_options threading;
+
+		/*
+		* Decodes video at a fraction of its resolution, e.g. for previews and thumbnails.
+		* Codecs that can decode at a lower resolution do it themselves (lowres in libavcodec: MPEG-1/2/4, MJPEG, ...),
+		 which is much faster. Others (e.g. H.264, HEVC) decode at full resolution, and receive() downscales each frame
+		 right after it's decoded, so the caller only ever sees small frames.
+		* Each dimension is rounded up. See input_decoder::get_output_video_info().
+		* Ignored for other streams.
+		*/
+		resolution_scale scale = resolution_scale::full;
+
+		/*
+		* Pixel formats (AVPixelFormat) to take, best first, when the codec offers a choice of formats for the frames
+		 of a stream (see AVCodecContext::get_format), e.g. those an encoder takes, so that frames need no conversion.
+		* The format of get_output_video_info() comes before all of them when it's offered, so that the frames keep matching
+		 an encoder created from it, e.g. when the codec asks again after the stream changed.
+		* Hardware formats are never taken for a preference. If none is offered, libavcodec chooses.
+		* Empty by default. Ignored for other streams. See format_negotiation.h.
+		*/
+		std::vector<int> preferred_pixel_formats;
 	};
 
 	/*
@@ -88,9 +246,58 @@ namespace ff
 	public:
 		input_decoder() = default;
 		// Creates the decoder for packets from a demuxer port
-		explicit input_decoder(const struct demuxer_port& port);
-		explicit input_decoder(const ::AVStream* stream);
+		explicit input_decoder(const struct demuxer_port& port, const decoder_options& opts = decoder_options());
+		explicit input_decoder(const ::AVStream* stream, const decoder_options& opts = decoder_options());
 
 		~input_decoder() { destroy(); }
+
+	public:
+		// @returns the arena the decoder uses for its frames, or nullptr if it doesn't use one.
+		const frame_buffer_arena* get_buffer_arena() const { return buffer_arena.get(); }
+
+		/*
+		* @returns the format and the size of the video frames the decoder outputs, which are those of the stream
+		 reduced by decoder_options::scale. Invalid for other streams.
+		*/
+		video_info get_output_video_info() const override { return output_info; }
+
+		// @returns true iff the codec decodes at the reduced resolution itself, instead of frames being downscaled afterwards.
+		bool is_scaled_by_codec() const { return scaled_by_codec; }
+
+		// @returns the options the decoder was created with.
+		const decoder_options& get_options() const { return options; }
+		// @returns the codec parameters of the stream the decoder was created for.
+		const ::AVCodecParameters* get_stream_parameters() const { return stream_params.get(); }
+
+		/*
+		* Makes the decoder, which must be flushed, ready for the packets of st, whose codec parameters are like those
+		 of the stream it was created for. See decoder_pool.
+		*/
+		void rebind(const ::AVStream* st);
+
+	protected:
+		// Downscales f if the codec cannot decode at the reduced resolution itself.
+		status finish_frame(ff::frame& f) noexcept override;
+
+	private:
+		// The get_buffer2 callback, which serves frames from the arena. ctx->opaque is the decoder.
+		static int get_buffer2(::AVCodecContext* ctx, ::AVFrame* frame, int flags);
+
+	private:
+		// Destroyed after the codec context, which is freed in the body of ~input_decoder().
+		std::unique_ptr<frame_buffer_arena> buffer_arena;
+
+		decoder_options options;
+		std::shared_ptr<::AVCodecParameters> stream_params;
+
+		// log2 of how many times smaller the frames are in each dimension. 0 for no scaling.
+		int scale_shift = 0;
+		bool scaled_by_codec = false;
+		video_info output_info;
+
+		// For downscaling after decoding. Rebuilt when the size or format of the decoded frames changes.
+		video_info downscaler_src;
+		std::unique_ptr<image_converter> downscaler;
+		std::unique_ptr<frame_pool> scaled_frames;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,168 @@
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "decoder_pool.h"
+#include "demuxer.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// @returns true iff a decoder opened for a stream of a decodes streams of b the same way.
+	bool same_parameters(const AVCodecParameters* a, const AVCodecParameters* b)
+	{
+		if (a->codec_type != b->codec_type || a->codec_id != b->codec_id ||
+			a->format != b->format || a->profile != b->profile || a->level != b->level ||
+			a->bits_per_coded_sample != b->bits_per_coded_sample)
+		{
+			return false;
+		}
+
+		// e.g. SPS/PPS, which the decoder parsed when it was opened.
+		if (a->extradata_size != b->extradata_size ||
+			(a->extradata_size > 0 && std::memcmp(a->extradata, b->extradata, a->extradata_size) != 0))
+		{
+			return false;
+		}
+
+		switch (a->codec_type)
+		{
+		case AVMEDIA_TYPE_VIDEO:
+			return a->width == b->width && a->height == b->height;
+		case AVMEDIA_TYPE_AUDIO:
+			return a->sample_rate == b->sample_rate && a->block_align == b->block_align &&
+				a->frame_size == b->frame_size && av_channel_layout_compare(&a->ch_layout, &b->ch_layout) == 0;
+		default:
+			return true;
+		}
+	}
+
+	bool same_options(const ff::decoder_options& a, const ff::decoder_options& b)
+	{
+		return a.use_buffer_arena == b.use_buffer_arena &&
+			(!a.use_buffer_arena || (a.arena_settings.num_slots == b.arena_settings.num_slots &&
+				a.arena_settings.huge_pages == b.arena_settings.huge_pages &&
+				a.arena_settings.prefault == b.arena_settings.prefault)) &&
+			a.threading.automatic == b.threading.automatic &&
+			a.threading.thread_count == b.threading.thread_count &&
+			a.threading.type == b.threading.type &&
+			a.threading.low_delay == b.threading.low_delay &&
+			a.threading.shared_pool == b.threading.shared_pool &&
+			a.scale == b.scale &&
+			a.preferred_pixel_formats == b.preferred_pixel_formats;
+	}
+}
+
+ff::decoder_pool& ff::decoder_pool::instance()
+{
+	static decoder_pool pool;
+	return pool;
+}
+
+ff::decoder_pool::decoder_pool()
+{
+	// The idle decoders give their threads back to the budget when the pool is destroyed at exit,
+	// so the budget must be constructed first, which makes it destroyed after the pool.
+	codec_thread_budget::instance();
+}
+
+std::unique_ptr<ff::input_decoder> ff::decoder_pool::acquire(const demuxer_port& port, const decoder_options& opts)
+{
+	return acquire(port.stream.p_stream, opts);
+}
+
+std::unique_ptr<ff::input_decoder> ff::decoder_pool::acquire(const ::AVStream* st, const decoder_options& opts)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++stats.num_acquisitions;
+
+		auto it = std::find_if(idle.begin(), idle.end(), [&](const std::unique_ptr<input_decoder>& dec)
+			{
+				return same_parameters(dec->get_stream_parameters(), st->codecpar) && same_options(dec->get_options(), opts);
+			});
+		if (it != idle.end())
+		{
+			++stats.num_reuses;
+
+			std::unique_ptr<input_decoder> dec = std::move(*it);
+			idle.erase(it);
+			dec->rebind(st);
+			return dec;
+		}
+	}
+
+	// Opening a codec takes a while, so not while holding the lock.
+	return std::make_unique<input_decoder>(st, opts);
+}
+
+void ff::decoder_pool::release(std::unique_ptr<input_decoder> dec)
+{
+	if (!dec || !dec->ready() || !dec->get_stream_parameters())
+	{
+		return;
+	}
+
+	// As good as a new one.
+	dec->flush_codec();
+	dec->set_skip(skip_options());
+	dec->set_packet_pool(nullptr);
+
+	std::list<std::unique_ptr<input_decoder>> evicted;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		idle.push_front(std::move(dec));
+		trim(evicted);
+	}
+	// evicted are destroyed here, which joins their threads, outside of the lock.
+}
+
+void ff::decoder_pool::trim(std::list<std::unique_ptr<input_decoder>>& evicted)
+{
+	while (idle.size() > capacity)
+	{
+		evicted.splice(evicted.end(), idle, std::prev(idle.end()));
+	}
+}
+
+void ff::decoder_pool::clear()
+{
+	std::list<std::unique_ptr<input_decoder>> evicted;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		evicted.swap(idle);
+	}
+}
+
+size_t ff::decoder_pool::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return idle.size();
+}
+
+size_t ff::decoder_pool::get_capacity() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return capacity;
+}
+
+void ff::decoder_pool::set_capacity(size_t n)
+{
+	std::list<std::unique_ptr<input_decoder>> evicted;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		capacity = n;
+		trim(evicted);
+	}
+}
+
+ff::decoder_pool::statistics ff::decoder_pool::get_statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
@@ -0,0 +1,93 @@
+/*
+* decoder_pool.h:
+* Defines a process-wide pool of opened decoders, so that jobs on the same kind of stream skip opening codecs.
+*/
+
+#pragma once
+
+#include "decoder.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+
+struct AVStream;
+struct AVCodecParameters;
+
+namespace ff
+{
+	/*
+	* Keeps input_decoders that are done with, and hands them out again instead of opening new ones.
+	* Opening a codec allocates its context and, with threads, starts them, which takes tens of milliseconds
+	 for threaded H.264 and HEVC.
+	*
+	* Decoders are keyed by the codec parameters of the stream they were created for (the codec, the format,
+	 the size or the sample rate and channels, the profile and the extradata) and by their decoder_options.
+	* A decoder given back is flushed and its skip options are reset, so it's as good as a new one
+	 for any stream with the same key, e.g. the same file after a seek, or another recording of the same camera.
+	*
+	* Idle decoders keep their threads, and what they reserved from the codec_thread_budget.
+	* When more than the capacity are idle, the least recently given back is destroyed.
+	*
+	* The pool is shared by the whole process. All methods are synchronized.
+	*/
+	class decoder_pool
+	{
+	public:
+		struct statistics
+		{
+			// the number of calls to acquire()
+			uint64_t num_acquisitions = 0;
+			// the number of them served with an idle decoder
+			uint64_t num_reuses = 0;
+		};
+
+	public:
+		// @returns the pool of the process.
+		static decoder_pool& instance();
+
+		decoder_pool(const decoder_pool&) = delete;
+		decoder_pool& operator=(const decoder_pool&) = delete;
+
+	public:
+		/*
+		* @returns an idle decoder for streams like st created with opts, or a new one if there is none.
+		* @throws std::runtime_error if a new decoder cannot be created
+		*/
+		std::unique_ptr<input_decoder> acquire(const ::AVStream* st, const decoder_options& opts = decoder_options());
+		std::unique_ptr<input_decoder> acquire(const struct demuxer_port& port, const decoder_options& opts = decoder_options());
+
+		/*
+		* Flushes dec and keeps it for later acquisitions.
+		* Any input_decoder can be given back, not only those acquired from the pool.
+		*/
+		void release(std::unique_ptr<input_decoder> dec);
+
+		// Destroys every idle decoder.
+		void clear();
+
+		// @returns the number of idle decoders.
+		size_t size() const;
+		size_t get_capacity() const;
+		// Destroys idle decoders at once if there are more than n.
+		void set_capacity(size_t n);
+
+		statistics get_statistics() const;
+
+	private:
+		decoder_pool();
+
+		// Moves the oldest idle decoders to evicted until there are at most capacity. Requires: the mutex is locked.
+		void trim(std::list<std::unique_ptr<input_decoder>>& evicted);
+
+	private:
+		mutable std::mutex mutex;
+
+		// The front is the most recently given back.
+		std::list<std::unique_ptr<input_decoder>> idle;
+		size_t capacity = 8;
+
+		statistics stats;
+	};
+}
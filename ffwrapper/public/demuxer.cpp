@@ -6,8 +6,10 @@ extern "C"
 #include <libavcodec/avcodec.h>
 }
 
+#include "packet_pool.h"
 #include "../private/ff_helpers.h"
 #include <stdexcept>
+#include <system_error>
 
 ff::demuxer_port::demuxer_port(demuxer& dem, int index) :
     stream(dem.format_ctx->streams[index]), in_use(true)
@@ -19,9 +21,233 @@ int ff::demuxer_port::get_required_decoder_id() const
     return stream->codecpar->codec_id;
 }
 
-void ff::demuxer_port::add_packet(ff::packet&& pkt)
+bool ff::demuxer_port::accepts(const ff::packet& pkt) const
 {
-    queue.emplace(std::move(pkt));
+    switch (discard)
+    {
+    case discard_mode::none:
+        return true;
+    case discard_mode::nonref:
+        return !(pkt->flags & AV_PKT_FLAG_DISPOSABLE);
+    case discard_mode::nonkey:
+        return pkt->flags & AV_PKT_FLAG_KEY;
+    default:
+        return false;
+    }
+}
+
+ff::demuxer_port::demuxer_port(demuxer_port&& other) noexcept :
+    queue_packet_source(std::move(other)), stream(other.stream), in_use(other.in_use),
+    discard(other.discard), ahead(std::move(other.ahead))
+{
+}
+
+bool ff::demuxer_port::add_packet(ff::packet&& pkt)
+{
+    if (!push(std::move(pkt)))
+    {
+        return false;
+    }
+    wake_consumers();
+    return true;
+}
+
+ff::packet ff::demuxer_port::try_get_one()
+{
+    std::unique_lock<std::mutex> lock(ahead_mutex);
+    return take(lock);
+}
+
+ff::packet ff::demuxer_port::take(std::unique_lock<std::mutex>& lock)
+{
+    // Nothing is queued while reading ahead, so the queued packets are always older than those read ahead.
+    ff::packet pkt = queue_packet_source::try_get_one();
+    if (!pkt.is_valid() && ahead)
+    {
+        pkt = ahead->try_get_one();
+        if (pkt.is_valid() && producer_waiting)
+        {
+            ahead_not_full.notify_one();
+        }
+    }
+    return pkt;
+}
+
+ff::packet ff::demuxer_port::wait_for_packet(const std::chrono::nanoseconds* timeout)
+{
+    std::unique_lock<std::mutex> lock(ahead_mutex);
+
+    // The port is closed after the last packet is put in, so a port that is closed before it's found empty stays empty.
+    bool closed = is_closed();
+    ff::packet pkt = take(lock);
+    if (pkt.is_valid() || closed)
+    {
+        return pkt;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ++num_consumers_waiting;
+    // Pairs with the fence in wake_consumers(): either the packet is seen here, or the waiting consumer is seen there.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto available = [this]()
+    {
+        return !queue_packet_source::empty() || (ahead && !ahead->empty()) || is_closed();
+    };
+    if (timeout)
+    {
+        ahead_not_empty.wait_for(lock, *timeout, available);
+    }
+    else
+    {
+        ahead_not_empty.wait(lock, available);
+    }
+    --num_consumers_waiting;
+    ahead_wait_stats.consumer_wait += std::chrono::steady_clock::now() - start;
+
+    return take(lock);
+}
+
+void ff::demuxer_port::wake_consumers()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_consumers_waiting.load(std::memory_order_relaxed) != 0)
+    {
+        std::lock_guard<std::mutex> lock(ahead_mutex);
+        ahead_not_empty.notify_all();
+    }
+}
+
+size_t ff::demuxer_port::size() const
+{
+    std::lock_guard<std::mutex> lock(ahead_mutex);
+    return queue_packet_source::size() + (ahead ? ahead->size() : 0);
+}
+
+const ff::packet& ff::demuxer_port::peek_first() const
+{
+    std::lock_guard<std::mutex> lock(ahead_mutex);
+    if (queue_packet_source::empty() && ahead)
+    {
+        return ahead->peek_first();
+    }
+    return queue_packet_source::peek_first();
+}
+
+void ff::demuxer_port::clear()
+{
+    std::lock_guard<std::mutex> lock(ahead_mutex);
+    queue_packet_source::clear();
+    if (ahead)
+    {
+        ahead->clear();
+        ahead_not_full.notify_one();
+    }
+}
+
+void ff::demuxer_port::close()
+{
+    queue_packet_source::close();
+
+    std::lock_guard<std::mutex> lock(ahead_mutex);
+    ahead_not_empty.notify_all();
+}
+
+ff::queue_wait_statistics ff::demuxer_port::get_wait_statistics() const
+{
+    queue_wait_statistics ret = queue_packet_source::get_wait_statistics();
+
+    std::lock_guard<std::mutex> lock(ahead_mutex);
+    ret.consumer_wait += ahead_wait_stats.consumer_wait;
+    ret.producer_wait += ahead_wait_stats.producer_wait;
+    return ret;
+}
+
+void ff::demuxer_port::prepare_ahead(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(ahead_mutex);
+    if (!ahead || ahead->capacity() < capacity)
+    {
+        // Left empty by move_ahead_to_queue().
+        ahead.reset(new spsc_queue_packet_source(capacity));
+    }
+}
+
+bool ff::demuxer_port::push_ahead(ff::packet&& pkt, const std::atomic<bool>& stop)
+{
+    // No lock unless the ring is full.
+    if (!ahead->try_push(std::move(pkt)))
+    {
+        std::unique_lock<std::mutex> lock(ahead_mutex);
+
+        auto start = std::chrono::steady_clock::now();
+        producer_waiting = true;
+        ahead_not_full.wait(lock, [&]() { return stop || ahead->size() < ahead->capacity(); });
+        producer_waiting = false;
+        ahead_wait_stats.producer_wait += std::chrono::steady_clock::now() - start;
+
+        if (stop)
+        {
+            return false;
+        }
+        // Only the consumers run meanwhile, and they only make room.
+        ahead->try_push(std::move(pkt));
+    }
+
+    wake_consumers();
+    return true;
+}
+
+void ff::demuxer_port::wake_producer()
+{
+    std::lock_guard<std::mutex> lock(ahead_mutex);
+    ahead_not_full.notify_all();
+}
+
+void ff::demuxer_port::move_ahead_to_queue(ff::packet* last)
+{
+    {
+        std::lock_guard<std::mutex> lock(ahead_mutex);
+        if ((!ahead || ahead->empty()) && !last)
+        {
+            return;
+        }
+
+        // Lifts the limit so that none is dropped or waited for. set_capacity() spills the extra ones when it's put back.
+        size_t cap = capacity();
+        overflow_policy policy = get_overflow_policy();
+        set_capacity(0);
+
+        ff::packet pkt(nullptr);
+        while (ahead && (pkt = ahead->try_get_one()).is_valid())
+        {
+            push(std::move(pkt));
+        }
+        if (last)
+        {
+            push(std::move(*last));
+        }
+
+        set_capacity(cap, policy);
+    }
+    wake_consumers();
+}
+
+namespace
+{
+    ::AVDiscard to_av_discard(ff::discard_mode mode)
+    {
+        switch (mode)
+        {
+        case ff::discard_mode::nonref:
+            return AVDISCARD_NONREF;
+        case ff::discard_mode::nonkey:
+            return AVDISCARD_NONKEY;
+        case ff::discard_mode::all:
+            return AVDISCARD_ALL;
+        default:
+            return AVDISCARD_DEFAULT;
+        }
+    }
 }
 
 ff::demuxer::demuxer(const input_media& m, const std::vector<int> unused_ports):
@@ -31,21 +257,51 @@ ff::demuxer::demuxer(const input_media& m, const std::vector<int> unused_ports):
 
     for (int i = 0, j = 0; i != m.num_streams(); ++i)
     {
+        // The media is shared with other demuxers, which may have left their own modes on the stream.
+        original_discards.push_back(format_ctx->streams[i]->discard);
+
         // j is the index of the first unused port that is not checked.
         // Now check if i == unused_ports[j]
-        if (j < unused_ports.size())
+        if (j < unused_ports.size() && i == unused_ports[j]) // skip this port
         {
-            if (i == unused_ports[j]) // skip this port
-            {
-                ++j; // go to the next unused port.
-                continue; 
-            }
+            ++j; // go to the next unused port.
+
+            // Neither read nor queue its packets.
+            ports[i].discard = discard_mode::all;
         }
-        else // don't skip this port
+        else
         {
+            // don't skip this port
             ports[i].stream = m.get_stream(i);
             ports[i].in_use = true;
         }
+        format_ctx->streams[i]->discard = to_av_discard(ports[i].discard);
+    }
+}
+
+void ff::demuxer::set_discard_mode(int i, discard_mode mode)
+{
+    if (!ports[i].is_used())
+    {
+        ON_FF_ERROR("Cannot change the discard mode of an unused port.")
+    }
+    if (is_reading_ahead())
+    {
+        ON_FF_ERROR("Cannot change the discard mode while reading ahead.")
+    }
+
+    ports[i].discard = mode;
+    format_ctx->streams[i]->discard = to_av_discard(mode);
+}
+
+ff::demuxer::~demuxer()
+{
+    stop_read_ahead();
+
+    // Leave the media as it was for the next demuxer.
+    for (size_t i = 0; i != original_discards.size(); ++i)
+    {
+        format_ctx->streams[i]->discard = (::AVDiscard)original_discards[i];
     }
 }
 
@@ -64,8 +320,41 @@ int ff::demuxer::seek(int64_t time, int ref_port)
         return -1;
     }
 
-    int err = 0;
-    if ((err = av_seek_frame
+    // The packets read ahead are from before the new position.
+    // Reading ahead that ended at the end of the file resumes from the new position too.
+    bool was_reading_ahead = reader.joinable();
+    if (was_reading_ahead)
+    {
+        stop_read_ahead();
+        for (auto& port : ports)
+        {
+            port.clear();
+        }
+        read_ahead_error = nullptr;
+    }
+
+    int ind = seek_and_put_keyframe(time, ref_port);
+
+    if (was_reading_ahead)
+    {
+        start_read_ahead(read_ahead_capacity);
+    }
+    return ind;
+}
+
+int ff::demuxer::seek_and_put_keyframe(int64_t time, int ref_port)
+{
+    int err = -1;
+
+    // Jump straight to the keyframe if the index of the file knows where it is.
+    const keyframe_index::entry* keyframe = file.get_keyframe_index().find(ref_port, time);
+    if (keyframe && !(format_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK))
+    {
+        err = av_seek_frame(format_ctx, ref_port, keyframe->pos, AVSEEK_FLAG_BYTE);
+    }
+
+    // Otherwise ask the container.
+    if (err < 0 && (err = av_seek_frame
     (
         format_ctx,
         ref_port,
@@ -77,44 +366,207 @@ int ff::demuxer::seek(int64_t time, int ref_port)
     }
 
     int ind = -1;
-    ff::packet pkt;
+    ff::packet pkt = acquire_packet();
 
     if ((err = av_read_frame(format_ctx, pkt)) >= 0)
     {
         ind = pkt->stream_index;
 
 		// found the packet. put it in the port and return.
-		ports[ind].add_packet(std::move(pkt));
-		return ind;
+		if (deliver_packet(std::move(pkt)))
+		{
+			return ind;
+		}
+
+		// The port discarded or dropped it. Go on to the next packet that is taken.
+		recycle_packet(pkt);
+		return demux_next_packet();
     }
     else if(err != AVERROR_EOF)
     {
         ON_FF_ERROR_WITH_CODE("Unexpected error during seeking.", err);
     }
 
+    recycle_packet(pkt);
     return -1;
 }
 
 int ff::demuxer::demux_next_packet()
 {
+    if (is_reading_ahead())
+    {
+        ON_FF_ERROR("Cannot demux packets one by one while reading ahead.")
+    }
+    // The thread ended by itself. Give the ports back their limits, or a full port would wait for its own caller.
+    stop_read_ahead();
+
     int ret = -1;
     int err = 0;
-    ff::packet pkt;
+    ff::packet pkt = acquire_packet();
 
-    if ((err = av_read_frame(format_ctx, pkt)) < 0)
+    // Read until a port takes the packet.
+    while (true)
     {
-        if (err == AVERROR_EOF)
+        if ((err = av_read_frame(format_ctx, pkt)) < 0)
         {
-            return -1;
+            if (err == AVERROR_EOF)
+            {
+                recycle_packet(pkt);
+                return -1;
+            }
+            else
+            {
+                ON_FF_ERROR_WITH_CODE("Could not demux the next packet.", err);
+            }
         }
-        else
+
+        ret = pkt->stream_index;
+        if (deliver_packet(std::move(pkt)))
         {
-            ON_FF_ERROR_WITH_CODE("Could not demux the next packet.", err);
+            return ret;
         }
+
+        // discarded, or dropped by a full port. The packet is still ours, so reuse it for the next read.
+        pkt.unref();
+    }
+}
+
+ff::packet ff::demuxer::acquire_packet()
+{
+    return pkt_pool ? pkt_pool->acquire() : ff::packet();
+}
+
+void ff::demuxer::recycle_packet(ff::packet& pkt)
+{
+    if (pkt_pool)
+    {
+        pkt_pool->release(pkt);
     }
+}
 
-    ret = pkt->stream_index;
-    ports[ret].add_packet(std::move(pkt));
+bool ff::demuxer::deliver_packet(ff::packet&& pkt)
+{
+    demuxer_port& port = ports[pkt->stream_index];
+    return port.accepts(pkt) && port.add_packet(std::move(pkt));
+}
 
-    return ret;
+void ff::demuxer::start_read_ahead(size_t capacity_per_port)
+{
+    if (is_reading_ahead())
+    {
+        return;
+    }
+    // A thread that ended by itself.
+    stop_read_ahead();
+
+    read_ahead_capacity = capacity_per_port;
+    for (auto& port : ports)
+    {
+        if (port.is_used())
+        {
+            port.prepare_ahead(capacity_per_port);
+        }
+        port.reopen();
+    }
+
+    stop_requested = false;
+    reader_done = false;
+    read_ahead_error = nullptr;
+    try
+    {
+        reader = std::thread(&demuxer::read_ahead_loop, this);
+    }
+    catch (const std::system_error& e)
+    {
+        ON_FF_ERROR(std::string("Could not start reading ahead. ") + e.what())
+    }
+}
+
+void ff::demuxer::stop_read_ahead()
+{
+    if (!reader.joinable())
+    {
+        return;
+    }
+
+    stop_requested = true;
+    // Wakes the thread up if it's waiting for room in a port. The ports are not closed,
+    // so that consumers waiting for packets do not take it for the end.
+    for (auto& port : ports)
+    {
+        port.wake_producer();
+    }
+    reader.join();
+
+    // The packet the thread was putting in goes behind the others of its port.
+    int last_port = undelivered.is_valid() ? undelivered->stream_index : -1;
+    for (int i = 0; i != (int)ports.size(); ++i)
+    {
+        // Closed at the end of the file. Reopened first, or the packets would be rejected.
+        ports[i].reopen();
+        ports[i].move_ahead_to_queue(i == last_port ? &undelivered : nullptr);
+    }
+    undelivered = ff::packet(nullptr);
+}
+
+void ff::demuxer::rethrow_read_ahead_error() const
+{
+    // The error is only written by the thread before it closes the ports, which the caller has seen.
+    if (read_ahead_error)
+    {
+        std::rethrow_exception(read_ahead_error);
+    }
+}
+
+void ff::demuxer::read_ahead_loop()
+{
+    try
+    {
+        ff::packet pkt(nullptr);
+        while (!stop_requested)
+        {
+            if (!pkt.is_valid())
+            {
+                pkt = acquire_packet();
+            }
+
+            int err = av_read_frame(format_ctx, pkt);
+            if (err == AVERROR_EOF)
+            {
+                break;
+            }
+            else if (err < 0)
+            {
+                ON_FF_ERROR_WITH_CODE("Could not demux the next packet.", err)
+            }
+
+            demuxer_port& port = ports[pkt->stream_index];
+            if (!port.accepts(pkt))
+            {
+                // The packet is still ours, so reuse it for the next read.
+                pkt.unref();
+            }
+            else if (!port.push_ahead(std::move(pkt), stop_requested))
+            {
+                // Stopped while waiting for room. stop_read_ahead() puts it in.
+                undelivered = std::move(pkt);
+                break;
+            }
+        }
+        recycle_packet(pkt);
+    }
+    catch (...)
+    {
+        read_ahead_error = std::current_exception();
+    }
+
+    // no more packets will come. Not when stopped: the ports are left open for the consumers.
+    if (!stop_requested)
+    {
+        for (auto& port : ports)
+        {
+            port.close();
+        }
+    }
+    reader_done = true;
 }
@@ -6,17 +6,55 @@
 #pragma once
 
 #include "interfaces/queue_src.h"
+#include "interfaces/spsc_queue_src.h"
 #include "media.h"
 #include "ff_time.h"
 
 #include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
 
 struct AVFormatContext;
 
 namespace ff
 {
+	/*
+	* Which packets of a stream are left out by the demuxer.
+	* The demuxer of the container format is told about it, so that it may skip them without reading them,
+	* and whatever it still returns is dropped before reaching the port.
+	*/
+	enum class discard_mode
+	{
+		// Keeps every packet.
+		none,
+		// Leaves out packets of non-reference frames (those flagged disposable), which no other frame depends on.
+		nonref,
+		// Leaves out everything but keyframes.
+		nonkey,
+		// Leaves out the whole stream. This is what unused ports do.
+		all
+	};
+
 	/*
 	* A demuxer port outputs the packets from a specific stream of the file.
+	* 
+	* By default a port buffers as many packets as the consumer leaves in it.
+	* Use set_capacity() to bound it; see queue_source.
+	* 
+	* When the demuxer reads ahead on its own thread (see demuxer::start_read_ahead()), the packets it reads go into
+	 a lock-free ring of the port (see spsc_queue_source) behind the packets already queued, so that the thread never waits
+	 for the lock of a consumer. Take packets out with wait_and_get_one(). An invalid packet means the port is closed and empty:
+	 the demuxer reached the end of the file or failed (see demuxer::rethrow_read_ahead_error()).
+	 Stopping the demuxer does not close its ports.
+	* get_wait_statistics() tells how long the consumer waited for the demuxer and the demuxer for the consumer.
+	* 
+	* The methods that take packets out are synchronized with each other, so any number of consumers may share a port.
+	* They hide those of queue_source, so call them on the port itself, not through a queue_source.
 	*/
 	struct demuxer_port : public queue_packet_source
 	{
@@ -28,22 +66,123 @@ namespace ff
 		* Creates a port associated with the demuxer at index.
 		*/
 		demuxer_port(class demuxer& dem, int index);
+		// Only while the demuxer is created. The mutex and the condition variables are not moved.
+		demuxer_port(demuxer_port&& other) noexcept;
+
+	public:
+		// Takes the first packet, whether it was queued or read ahead.
+		ff::packet try_get_one() override;
+
+		/*
+		* Waits until a packet is available and extracts it.
+		* @returns the packet, or an invalid packet if the port is closed and empty (i.e. no more will come).
+		*/
+		ff::packet wait_and_get_one() { return wait_for_packet(nullptr); }
+
+		/*
+		* Waits at most timeout until a packet is available and extracts it.
+		* @returns the packet, or an invalid packet if the time is out, or if the port is closed and empty.
+		* Check is_closed() to tell the two apart.
+		*/
+		template <typename Rep, typename Period>
+		ff::packet wait_and_get_one(std::chrono::duration<Rep, Period> timeout)
+		{
+			std::chrono::nanoseconds ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout);
+			return wait_for_packet(&ns);
+		}
+
+		// @returns the number of packets available, including those read ahead.
+		size_t size() const;
+		bool empty() const { return size() == 0; }
+
+		const ff::packet& peek_first() const override;
+
+		// Discards the packets queued and read ahead.
+		void clear() override;
+
+		// Also wakes up the consumers waiting in wait_and_get_one().
+		void close();
+
+		// Includes the waits for the packets read ahead.
+		queue_wait_statistics get_wait_statistics() const;
 
 	public:
 		bool is_used() const { return in_use; }
 
+		discard_mode get_discard_mode() const { return discard; }
+
+		// @returns false iff pkt is left out by the discard mode of the port.
+		bool accepts(const ff::packet& pkt) const;
+
 		// @returns the id of the decoder that is the only option for decoding the packets from here.
 		int get_required_decoder_id() const;
 
-		// Adds a packet using the move constructor.
-		// Should only be called by its demuxer.
-		void add_packet(ff::packet&& pkt);
+		/*
+		* Adds a packet using the move constructor.
+		* Should only be called by its demuxer.
+		* 
+		* @returns false if the port is full and its overflow policy is drop, or if the port is closed. Then pkt is left untouched.
+		*/
+		bool add_packet(ff::packet&& pkt);
 
 	public:
 		input_stream stream;
 
 		// The user may choose to ignore a particular stream. On this case, the field is false.		
 		bool in_use;
+
+	private:
+		friend class demuxer;
+		discard_mode discard = discard_mode::none;
+
+	private:
+		// @param timeout: nullptr to wait forever.
+		ff::packet wait_for_packet(const std::chrono::nanoseconds* timeout);
+
+		// Requires: lock holds ahead_mutex.
+		// Takes the first queued packet, or the first packet read ahead if none is queued.
+		ff::packet take(std::unique_lock<std::mutex>& lock);
+
+		// Wakes up the consumers waiting in wait_and_get_one() after a packet is put in, if there are any.
+		void wake_consumers();
+
+		// The demuxer's side of reading ahead.
+
+		// Gives the port a ring of at least capacity packets to read ahead into, keeping the one it has if it's large enough.
+		void prepare_ahead(size_t capacity);
+
+		/*
+		* Called by the read-ahead thread only. Pushes pkt into the ring, waiting for room if it's full.
+		* @returns false if stop is set first, in which case pkt is left untouched.
+		*/
+		bool push_ahead(ff::packet&& pkt, const std::atomic<bool>& stop);
+
+		// Wakes up the read-ahead thread if it's waiting for room, so that it checks its stop flag.
+		void wake_producer();
+
+		/*
+		* Requires: the read-ahead thread has ended.
+		* Moves the packets read ahead, then last if it's not nullptr, behind the queued packets. None is dropped:
+		* those over the capacity are spilled, whatever the policy is.
+		*/
+		void move_ahead_to_queue(ff::packet* last);
+
+	private:
+		// The packets read ahead, behind the queued ones. Only the read-ahead thread pushes into it.
+		// Allocated by the first start_read_ahead() and kept, empty, when it stops.
+		std::unique_ptr<spsc_queue_packet_source> ahead;
+
+		// Serializes the consumers, so that the ring has one at a time, and guards the waits of both sides.
+		// The read-ahead thread only locks it to wait for room or to wake up a waiting consumer.
+		mutable std::mutex ahead_mutex;
+		// Notified when a packet is put in or the port is closed.
+		std::condition_variable ahead_not_empty;
+		// Notified when a packet read ahead is taken out, or when the read-ahead thread is stopped.
+		std::condition_variable ahead_not_full;
+		std::atomic<int> num_consumers_waiting{ 0 };
+		bool producer_waiting = false;
+		// The waits of wait_and_get_one() and of push_ahead(). Guarded by ahead_mutex.
+		queue_wait_statistics ahead_wait_stats;
 	};
 
 	class demuxer
@@ -56,13 +195,17 @@ namespace ff
 		* Creates a demuxer associated with media m.
 		* @param m: the input media
 		* @param unused_ports: the indices of unused ports, in ascending order.
-		* Empty by default.
+		* Empty by default. The streams of unused ports are discarded (see discard_mode::all).
+		* m must outlive the demuxer: its destructor restores the discard of the streams of m.
 		*/
 		demuxer(const input_media& m, const std::vector<int> unused_ports = {});
 
 		// I do not see a reason to enable this now.
 		demuxer(const demuxer&) = delete;
 
+		// Stops reading ahead if it's running, and gives the streams of the media back their discard. Destroy it before the media.
+		~demuxer();
+
 	public:
 		/*
 		* Seeks to time in the time base of the stream of ref_port.
@@ -74,8 +217,14 @@ namespace ff
 		 From the first keyframe before t, we check one by one and compare its time with the parameter until we find the one we want.
 		 Generally speaking, there's no way to just stop before the frame within t.
 		*
+		* If the input media has a keyframe index for the stream (see keyframe_index), the demuxer jumps to the byte position
+		 of the keyframe recorded there instead of relying on the index of the container.
+		* 
 		* If it succeeds, then the keyframe will be put in its corresponding port.
 		* 
+		* If the demuxer is reading ahead, the reading is stopped, all ports are cleared, and the reading resumes
+		 from the new position after the keyframe is put.
+		* 
 		* After a successful seeking, any decoder that was previously decoding packets from any port of the demuxer must be flushed
 		* by calling its flush() method.
 		* 
@@ -87,14 +236,85 @@ namespace ff
 
 		/*
 		* Demuxes the next packet and puts it into the corresponding demuxer port.
+		* Packets dropped by full ports (see overflow_policy::drop) are skipped.
+		* Must not be called while the demuxer is reading ahead. If reading ahead ended by itself (at the end of the file
+		 or on failure), it's stopped first (see stop_read_ahead()), so the ports are reopened.
 		* 
 		* @returns the port number of the port where the next packet is put, or -1 if there are no more packets.
+		* @throws std::runtime_error on failure
 		*/
 		int demux_next_packet();
 
+		/*
+		* Starts a thread that demuxes packets into the ports ahead of the consumers, so that reading the file
+		 overlaps decoding.
+		* 
+		* The thread puts the packets of each used port into a lock-free ring of capacity_per_port packets,
+		 rounded up to a power of 2, behind the packets already in the port. The capacity and the policy of the port
+		 do not apply to them: the thread waits when a ring is full, so every used port must be drained, or it waits forever.
+		* Unused ports are left as they are, as they receive no packets.
+		* 
+		* When the end of the file is reached or reading fails, all ports are closed.
+		* Does nothing if the demuxer is already reading ahead.
+		* 
+		* @throws std::runtime_error if the thread could not be started
+		*/
+		void start_read_ahead(size_t capacity_per_port = 64);
+
+		/*
+		* Stops the thread and waits for it to end. Packets already in the ports are kept, and so is the packet
+		 the thread was delivering. The ports are not closed, so consumers waiting in wait_and_get_one() keep waiting.
+		* The packets read ahead join the queues of their ports. Those over the capacity of a port are spilled,
+		 whatever its policy is (see queue_source::set_capacity()). The ports closed at the end of the file are reopened.
+		* Also cleans up after a thread that ended by itself. Does nothing if there was no thread.
+		*/
+		void stop_read_ahead();
+
+		// @returns true iff the thread is running. It ends by itself at the end of the file or on failure.
+		bool is_reading_ahead() const { return reader.joinable() && !reader_done; }
+
+		/*
+		* Rethrows the exception that ended reading ahead, if there is one.
+		* Call it when a port returns an invalid packet to tell a failure from the end of the file.
+		*/
+		void rethrow_read_ahead_error() const;
+
+		/*
+		* Sets which packets of the stream of port i are left out.
+		* Must not be called while the demuxer is reading ahead.
+		* The mode is also set on the stream of the media, until the demuxer is destroyed. Only one demuxer should use a media at a time.
+		* 
+		* @throws std::runtime_error if the port is unused, or if the demuxer is reading ahead
+		*/
+		void set_discard_mode(int i, discard_mode mode);
+
 		const demuxer_port& get_port(int i) const { return ports[i]; }
 		demuxer_port& get_port(int i) { return ports[i]; }
 
+		/*
+		* Makes the demuxer take the packets it outputs from pool instead of allocating them.
+		* The pool is not owned by the demuxer and must outlive it, or be unset by passing nullptr.
+		*/
+		void set_packet_pool(class packet_pool* pool) { pkt_pool = pool; }
+
+	private:
+		// @returns a clean packet from the pool if there is one, or a newly allocated one otherwise.
+		ff::packet acquire_packet();
+		// Gives an unused packet back to the pool if there is one. Otherwise it's left to be destroyed.
+		void recycle_packet(ff::packet& pkt);
+
+		/*
+		* Puts pkt into its port unless the port discards it.
+		* @returns false if the packet is discarded or dropped. Then pkt is left untouched.
+		*/
+		bool deliver_packet(ff::packet&& pkt);
+
+		// The seeking itself. Requires: the demuxer is not reading ahead.
+		int seek_and_put_keyframe(int64_t time, int ref_port);
+
+		// The body of the read-ahead thread.
+		void read_ahead_loop();
+
 	private:
 
 		// For faster access, demuxer ports are stored in an array so that the time to access the port of stream i is O(0).
@@ -102,5 +322,20 @@ namespace ff
 
 		const input_media& file;
 		::AVFormatContext* format_ctx;
+		// the discard of each stream of the media before this demuxer set its own (an AVDiscard), put back when it's destroyed
+		std::vector<int> original_discards;
+
+		// Does not own this.
+		class packet_pool* pkt_pool = nullptr;
+
+		// read-ahead
+		std::thread reader;
+		std::atomic<bool> stop_requested{ false };
+		// set by the thread when it ends, whatever the reason
+		std::atomic<bool> reader_done{ false };
+		// the packet the thread had read when it was stopped, put into its port by stop_read_ahead()
+		ff::packet undelivered{ nullptr };
+		size_t read_ahead_capacity = 0;
+		std::exception_ptr read_ahead_error;
 	};
 }
\ No newline at end of file
@@ -2,6 +2,7 @@ extern "C"
 {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
 }
 
 #include "media.h"
@@ -9,6 +10,7 @@ extern "C"
 #include "demuxer.h"
 #include "encoder.h"
 #include "decoder.h"
+#include "packet_pool.h"
 #include "../private/ff_helpers.h"
 #include "../private/ff_math_helpers.h"
 #include "../private/utility/info.h"
@@ -41,46 +43,65 @@ ff::encoder::encoder(int ID)
 
 bool ff::encoder::try_feed(ff::frame& frame)
 {
-	int ret = avcodec_send_frame(codec_ctx, frame);
+	status st = feed(frame);
 
-	if (ret < 0)
+	if (st.is_error())
 	{
-		switch (ret)
-		{
-		case AVERROR_EOF:
-			// Intentionally no break.
-		case AVERROR(EAGAIN):
-			return false;
-		default:
-			ON_FF_ERROR_WITH_CODE("Could not feed a frame to the encoder.", ret);
-		}
+		ON_FF_ERROR_WITH_CODE("Could not feed a frame to the encoder.", st.code);
 	}
 
-	return true;
+	return st.ok();
+}
+
+ff::status ff::encoder::feed(ff::frame& frame) noexcept
+{
+	return status(avcodec_send_frame(codec_ctx, frame));
 }
 
 ff::packet ff::encoder::try_get_one()
 {
-	ff::packet pkt;
-	int ret = avcodec_receive_packet(codec_ctx, pkt);
+	ff::packet pkt(nullptr);
+	status st = receive(pkt);
 
-	if (ret >= 0) // we got the frame we want
+	if (st.ok()) // we got the packet we want
 	{
 		return pkt;
 	}
-	else
+	else if (st.is_error())
+	{
+		ON_FF_ERROR_WITH_CODE("Could not encode a packet.", st.code);
+	}
+
+	if (pkt_pool)
+	{
+		pkt_pool->release(pkt);
+	}
+	return ff::packet(nullptr);
+}
+
+ff::status ff::encoder::receive(ff::packet& reuse) noexcept
+{
+	if (!reuse.is_valid())
 	{
-		switch (ret)
+		bool allocated = pkt_pool ? 
+			pkt_pool->try_acquire(reuse) : 
+			(reuse.buffer = av_packet_alloc()) != nullptr;
+
+		if (!allocated)
 		{
-		case AVERROR_EOF:
-			eof_reached = true;
-			// Intentionally no break.
-		case AVERROR(EAGAIN):
-			return ff::packet(nullptr);
-		default:
-			ON_FF_ERROR_WITH_CODE("Could not encode a packet.", ret);
+			return status(AVERROR(ENOMEM));
 		}
 	}
+
+	// avcodec_receive_packet() unrefs whatever reuse held.
+	status st(avcodec_receive_packet(codec_ctx, reuse));
+
+	if (st.eof())
+	{
+		eof_reached = true;
+	}
+
+	return st;
 }
 
 void ff::encoder::flush_codec()
@@ -104,6 +125,20 @@ int ff::encoder::get_desired_pixel_format() const
 	return get_codec()->pix_fmts[0];
 }
 
+int ff::encoder::get_best_pixel_format_for(int src_fmt) const
+{
+	if (!codec->pix_fmts || is_pixel_format_supported(src_fmt))
+	{
+		return src_fmt;
+	}
+
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)src_fmt);
+	int has_alpha = desc && (desc->flags & AV_PIX_FMT_FLAG_ALPHA);
+	AVPixelFormat best = avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, (AVPixelFormat)src_fmt, has_alpha, nullptr);
+
+	return best != AV_PIX_FMT_NONE ? (int)best : get_desired_pixel_format();
+}
+
 void ff::encoder::get_best_audio_channel(::AVChannelLayout* dst) const
 {
 	const AVChannelLayout* p, *best_ch_layout = nullptr;
@@ -200,6 +235,9 @@ void ff::encoder::fill_encoder_info(const decoder& dec, const output_media& m)
 		// We must use frame_rate or sample_rate to set time_base of the encoder then.
 		bool time_base_set = false;
 
+		// The video frames the decoder outputs, which may be smaller than those of the stream.
+		video_info decoded = dec.get_output_video_info();
+
 		codec_ctx->bit_rate = dec_ctx->bit_rate;
 
 		//if (dec_ctx->bit_rate != 0)
@@ -209,10 +247,10 @@ void ff::encoder::fill_encoder_info(const decoder& dec, const output_media& m)
 		switch (codec->type)
 		{
 		case AVMEDIA_TYPE_VIDEO:
-			codec_ctx->pix_fmt = is_pixel_format_supported(dec_ctx->pix_fmt) ?
-				dec_ctx->pix_fmt : (AVPixelFormat)get_desired_pixel_format();
-			codec_ctx->width = dec_ctx->width;
-			codec_ctx->height = dec_ctx->height;
+			// Takes the frames as the decoder outputs them if it can, so that they need no conversion. See format_negotiation.h.
+			codec_ctx->pix_fmt = (AVPixelFormat)get_best_pixel_format_for(decoded.pix_fmt);
+			codec_ctx->width = decoded.width;
+			codec_ctx->height = decoded.height;
 
 			// if the frame rate is known, then set the time base accordingly.
 			if (dec_ctx->framerate.num != 0 && dec_ctx->framerate.den != 0) 
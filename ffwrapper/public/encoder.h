@@ -6,6 +6,7 @@
 #pragma once
 
 #include "codec.h"
+#include "status.h"
 #include "interfaces/src_sink.h"
 
 struct AVChannelLayout;
@@ -45,6 +46,13 @@ namespace ff
 		*/
 		bool try_feed(ff::frame & frame) override;
 
+		/*
+		* The non-throwing version of try_feed().
+		* @returns ok() if the frame is fed; again() if packets must be retrieved first; eof() if the encoder is draining;
+		* is_error() on failure.
+		*/
+		status feed(ff::frame& frame) noexcept;
+
 		/*
 		* Tries to encode the next packet
 		*
@@ -54,6 +62,15 @@ namespace ff
 		*/
 		ff::packet try_get_one() override;
 
+		/*
+		* The non-throwing version of try_get_one(), which encodes into reuse instead of a new packet.
+		* If reuse is invalid, then it gets a shell from the packet pool, or a newly allocated one.
+		* 
+		* @returns ok() if reuse holds an encoded packet; again() if more frames are needed;
+		* eof() if all packets are out (eof() of the encoder becomes true); is_error() on failure.
+		*/
+		status receive(ff::packet& reuse) noexcept;
+
 		/*
 		* Flushes the encoder and resets its eof state.
 		* Can be called after a draining is complete so that the encoder can be reused.
@@ -70,6 +87,12 @@ namespace ff
 		// is eof reached in draining.
 		bool eof() const { return eof_reached; }
 
+		/*
+		* Makes the encoder take the packets it outputs from pool instead of allocating them.
+		* The pool is not owned by the encoder and must outlive it, or be unset by passing nullptr.
+		*/
+		void set_packet_pool(class packet_pool* pool) { pkt_pool = pool; }
+
 	public:
 
 		// These methods are virtual whenever the format is not strictly required so the implementations may decide to use different ones. 
@@ -77,6 +100,12 @@ namespace ff
 		// @returns the "best" pixel format supported by the encoder.
 		virtual int get_desired_pixel_format() const;
 
+		/*
+		* @returns src_fmt if the encoder takes it, or if it does not tell which formats it takes;
+		 otherwise the format it takes that frames of src_fmt convert to with the least loss.
+		*/
+		virtual int get_best_pixel_format_for(int src_fmt) const;
+
 		// Selects the audio layout of the highest channel count supported by the codec,
 		// and copies the layout configuration to dst
 		virtual void get_best_audio_channel(::AVChannelLayout* dst) const;
@@ -123,6 +152,9 @@ namespace ff
 	protected:
 		bool eof_reached = false;
 
+		// Does not own this.
+		class packet_pool* pkt_pool = nullptr;
+
 	public:
 
 
@@ -160,6 +192,8 @@ namespace ff
 		// A encoder of ID that transcodes frames decoded by dec.
 		transcode_encoder(const class decoder& dec, const class output_media& m, int ID);
 
+		~transcode_encoder() { destroy(); }
+
 	private:
 
 
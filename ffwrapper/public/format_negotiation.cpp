@@ -0,0 +1,91 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "format_negotiation.h"
+#include "decoder.h"
+#include "encoder.h"
+
+namespace
+{
+	std::vector<int> pixel_formats_of(const AVCodec* enc)
+	{
+		std::vector<int> ret;
+		if (enc && enc->pix_fmts)
+		{
+			for (const AVPixelFormat* p = enc->pix_fmts; *p != AV_PIX_FMT_NONE; ++p)
+			{
+				ret.push_back(*p);
+			}
+		}
+		return ret;
+	}
+
+	std::string describe(const ff::video_info& v)
+	{
+		const char* name = av_get_pix_fmt_name((AVPixelFormat)v.pix_fmt);
+		return std::string(name ? name : "unknown") + " " + std::to_string(v.width) + "x" + std::to_string(v.height);
+	}
+}
+
+std::string ff::pixel_format_path::to_string() const
+{
+	if (!needs_conversion())
+	{
+		return describe(decoded) + ", no conversion";
+	}
+
+	static const struct { int flag; const char* what; } losses[] =
+	{
+		{ FF_LOSS_RESOLUTION, "chroma resolution" },
+		{ FF_LOSS_DEPTH, "depth" },
+		{ FF_LOSS_COLORSPACE, "colorspace" },
+		{ FF_LOSS_ALPHA, "alpha" },
+		{ FF_LOSS_COLORQUANT, "color quantization" },
+		{ FF_LOSS_CHROMA, "chroma" },
+	};
+
+	std::string lost;
+	for (const auto& l : losses)
+	{
+		if (loss & l.flag)
+		{
+			lost += lost.empty() ? " (loses " : ", ";
+			lost += l.what;
+		}
+	}
+	if (!lost.empty())
+	{
+		lost += ")";
+	}
+
+	return describe(decoded) + " -> swscale" + lost + " -> " + describe(encoded);
+}
+
+std::vector<int> ff::get_encoder_pixel_formats(int ID)
+{
+	return pixel_formats_of(avcodec_find_encoder((AVCodecID)ID));
+}
+
+std::vector<int> ff::get_encoder_pixel_formats(const char* name)
+{
+	return pixel_formats_of(avcodec_find_encoder_by_name(name));
+}
+
+ff::pixel_format_path ff::get_pixel_format_path(const decoder& dec, const encoder& enc)
+{
+	pixel_format_path path;
+	path.decoded = dec.get_output_video_info();
+	enc.get_current_video_info(path.encoded);
+
+	if (path.needs_conversion() && path.decoded.valid() && path.encoded.valid())
+	{
+		const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)path.decoded.pix_fmt);
+		int has_alpha = desc && (desc->flags & AV_PIX_FMT_FLAG_ALPHA);
+		path.loss = av_get_pix_fmt_loss((AVPixelFormat)path.encoded.pix_fmt, (AVPixelFormat)path.decoded.pix_fmt, has_alpha);
+	}
+
+	return path;
+}
@@ -0,0 +1,53 @@
+/*
+* format_negotiation.h:
+* Defines how a pipeline picks the pixel formats between a decoder and an encoder, so that frames are converted as little as possible.
+*/
+
+#pragma once
+
+#include "../private/utility/info.h"
+
+#include <string>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* The formats video frames take from a decoder to an encoder, as negotiated when a pipeline is built:
+	*
+	* 1. Before the decoder is created, its decoder_options::preferred_pixel_formats are set to the formats the encoder takes
+	 (see get_encoder_pixel_formats()). When the codec offers a choice of formats for the stream, the decoder takes
+	 the first of them it's offered, unless it's offered the format it already outputs (see decoder::get_output_video_info()),
+	 which the encoder is created for in 2. and which it then keeps.
+	* 2. The encoder (a transcode_encoder or a direct_encoder) takes the format the decoder outputs if it supports it,
+	 or else the one that frames convert to with the least loss (see encoder::get_best_pixel_format_for()).
+	* 3. After both are created, get_pixel_format_path() tells if a conversion (a swscale pass) is left, and which.
+	*
+	* libavcodec's software decoders seldom offer more than one software format, so most conversions are avoided in 2.
+	*/
+	struct pixel_format_path
+	{
+		// the frames out of the decoder
+		video_info decoded;
+		// the frames into the encoder
+		video_info encoded;
+		// What converting decoded to encoded loses (FF_LOSS_* flags). 0 if it loses nothing, or if there is no conversion.
+		int loss = 0;
+
+		// @returns true iff frames must be converted between the decoder and the encoder.
+		bool needs_conversion() const { return decoded != encoded; }
+
+		// @returns e.g. "yuv420p10le 1920x1080 -> swscale (loses depth) -> yuv420p 1920x1080", or "yuv420p 1920x1080, no conversion".
+		std::string to_string() const;
+	};
+
+	/*
+	* @returns the pixel formats the encoder of the ID or of the name takes, in its order of preference.
+	 Empty if it does not tell, or if there is no such encoder.
+	*/
+	std::vector<int> get_encoder_pixel_formats(int ID);
+	std::vector<int> get_encoder_pixel_formats(const char* name);
+
+	// @returns the path of video frames from dec to enc, which are both created.
+	pixel_format_path get_pixel_format_path(const class decoder& dec, const class encoder& enc);
+}
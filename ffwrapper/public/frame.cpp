@@ -17,7 +17,7 @@ ff::frame::frame(const frame& other)
 	{
 		allocate();
 
-		av_frame_copy_all(buffer, other.buffer);
+		ref_from(buffer, other.buffer);
 	}
 	else
 	{
@@ -25,6 +25,34 @@ ff::frame::frame(const frame& other)
 	}
 }
 
+ff::frame& ff::frame::operator=(const frame& right)
+{
+	if (this == &right)
+	{
+		return *this;
+	}
+
+	if (right.is_valid())
+	{
+		if (is_valid())
+		{
+			av_frame_unref(buffer);
+		}
+		else
+		{
+			allocate();
+		}
+
+		ref_from(buffer, right.buffer);
+	}
+	else
+	{
+		destroy();
+	}
+
+	return *this;
+}
+
 ff::frame::~frame()
 {
 	destroy();
@@ -49,7 +77,10 @@ void ff::frame::allocate()
 
 void ff::frame::unref()
 {
-	av_frame_unref(buffer);
+	if (buffer)
+	{
+		av_frame_unref(buffer);
+	}
 }
 
 void ff::frame::destroy()
@@ -86,6 +117,96 @@ void ff::frame::create_audio_buffer(int nb_samples, int sample_format, const AVC
 	}
 }
 
+ff::frame ff::frame::clone() const
+{
+	if (!is_valid())
+	{
+		return ff::frame(nullptr);
+	}
+
+	ff::frame ret;
+	if (has_a_buffer())
+	{
+		if (buffer->nb_samples > 0) // audio
+		{
+			ret.create_audio_buffer(buffer->nb_samples, buffer->format, &buffer->ch_layout);
+		}
+		else // video
+		{
+			ret.create_video_buffer(buffer->width, buffer->height, buffer->format);
+		}
+
+		av_frame_copy_all(ret, buffer);
+	}
+	else
+	{
+		if (av_frame_copy_props(ret, buffer) < 0)
+		{
+			ON_FF_ERROR("Could not copy AVFrame prop.")
+		}
+	}
+
+	return ret;
+}
+
+bool ff::frame::is_writable() const
+{
+	return av_frame_is_writable(buffer) != 0;
+}
+
+void ff::frame::make_writable()
+{
+	int ret;
+	if ((ret = av_frame_make_writable(buffer)) < 0)
+	{
+		ON_FF_ERROR_WITH_CODE("Could not make the frame writable", ret)
+	}
+}
+
+void ff::frame::make_writable_without_copy()
+{
+	if (!has_a_buffer() || is_writable())
+	{
+		return;
+	}
+
+	ff::frame fresh;
+	if (av_frame_copy_props(fresh, buffer) < 0)
+	{
+		ON_FF_ERROR("Could not copy AVFrame prop.")
+	}
+	if (buffer->nb_samples > 0) // audio
+	{
+		fresh.create_audio_buffer(buffer->nb_samples, buffer->format, &buffer->ch_layout);
+	}
+	else // video
+	{
+		fresh.create_video_buffer(buffer->width, buffer->height, buffer->format);
+	}
+
+	// The old data stays with the frames that share it.
+	*this = std::move(fresh);
+}
+
+void ff::frame::ref_from(::AVFrame* dst, ::AVFrame* src)
+{
+	int ret;
+	if (src->buf[0]) // ref-counted. Share the data.
+	{
+		if ((ret = av_frame_ref(dst, src)) < 0)
+		{
+			ON_FF_ERROR_WITH_CODE("Could not ref AVFrame", ret)
+		}
+	}
+	else // nothing to share. Only copy the props.
+	{
+		if ((ret = av_frame_copy_props(dst, src)) < 0)
+		{
+			ON_FF_ERROR_WITH_CODE("Could not copy AVFrame prop.", ret)
+		}
+	}
+}
+
 void ff::frame::av_frame_copy_all(::AVFrame* dst, ::AVFrame* src)
 {
 	if (av_frame_copy_props(dst, src) < 0)
@@ -156,7 +277,10 @@ void ff::packet::allocate()
 
 void ff::packet::unref()
 {
-	av_packet_unref(buffer);
+	if (buffer)
+	{
+		av_packet_unref(buffer);
+	}
 }
 
 void ff::packet::destroy()
@@ -11,6 +11,7 @@ namespace ff
 	// A buffer holding a decoded frame.
 	// Has two levels of storage. The first level is the frame itself, which also has to be allocated (will be done by the constructors)
 	// The second level is the data is holds, which is created by one of the create_xxx_buffer() methods.
+	// The data is reference-counted. Copies of a frame share the data; use clone() for a deep copy.
 	// On destruction, both levels of storage will be destroyed.
 	struct frame
 	{
@@ -19,14 +20,26 @@ namespace ff
 		frame() : buffer(nullptr) { allocate(); }
 		// Takes the ownership of f
 		frame(struct ::AVFrame* f) : buffer(f) {}
-		// throws std::runtime_error
+		/*
+		* Makes a new frame that refs other's data instead of copying it.
+		* Call make_writable() before modifying the data of either of them.
+		* @throws std::runtime_error on failure
+		*/
 		frame(const frame& other);
 		frame(frame&& other) noexcept : buffer(other.buffer) { other.relinquish_ownership(); }
 
+		// Unrefs the data it holds and refs right's data instead.
+		// @throws std::runtime_error on failure
+		frame& operator=(const frame& right);
+		// Destroys the frame it holds and takes the ownership of right's
 		inline frame& operator=(frame&& right) noexcept
 		{
-			buffer = right.buffer;
-			right.relinquish_ownership();
+			if (this != &right)
+			{
+				destroy();
+				buffer = right.buffer;
+				right.relinquish_ownership();
+			}
 			return *this;
 		}
 
@@ -46,7 +59,7 @@ namespace ff
 		// Destroy the frame and delete everything it stores
 		void destroy();
 
-		// unrefs the data it owns but does not destroy the frame.
+		// unrefs the data it owns but does not destroy the frame. Does nothing if the frame is invalid.
 		void unref();
 
 		/*
@@ -64,6 +77,29 @@ namespace ff
 
 		void create_audio_buffer(int nb_samples, int sample_format, const ::AVChannelLayout* ch_layout, int alignment = 0);
 
+		/*
+		* @returns a deep copy of the frame, whose data is not shared with this one.
+		* @throws std::runtime_error on failure
+		*/
+		frame clone() const;
+
+		// @returns true iff the data is only referenced by this frame and can thus be modified.
+		bool is_writable() const;
+
+		/*
+		* Copy-on-write: if the data is shared with other frames, copies it so that this frame has its own.
+		* Does nothing if it's already writable. Any stage that modifies the data of a frame should call this first.
+		* @throws std::runtime_error on failure
+		*/
+		void make_writable();
+
+		/*
+		* Like make_writable(), but the shared data is dropped rather than copied: the frame gets new planes of the same format
+		 and size, whose content is undefined. Its props are kept. For stages that overwrite all the data, like converters.
+		* @throws std::runtime_error on failure
+		*/
+		void make_writable_without_copy();
+
 	public:
 		struct ::AVFrame* buffer = nullptr;
 
@@ -76,6 +112,11 @@ namespace ff
 		// The same as av_frame_copy_props + av_frame_copy
 		// @throws std::runtime_error on failure
 		static void av_frame_copy_all(struct ::AVFrame* dst, struct ::AVFrame* src);
+
+	private:
+		// Refs src's data in dst if it is ref-counted. Otherwise only copies its props.
+		// @throws std::runtime_error on failure
+		static void ref_from(struct ::AVFrame* dst, struct ::AVFrame* src);
 	};
 
 	// An encoded packet.
@@ -94,8 +135,12 @@ namespace ff
 		packet& operator=(const packet& right);
 		inline packet& operator=(packet&& right) noexcept
 		{
-			buffer = right.buffer;
-			right.relinquish_ownership();
+			if (this != &right)
+			{
+				destroy();
+				buffer = right.buffer;
+				right.relinquish_ownership();
+			}
 			return *this;
 		}
 
@@ -111,7 +156,8 @@ namespace ff
 		// @throws std::runtime_error on failure
 		void allocate();
 
-		// Unrefs its data it holds but does not destroy the packet itself.
+		// Unrefs its data it holds but does not destroy the packet itself. Does nothing if the packet is invalid,
+		// e.g. after it's given back to a packet pool by feed().
 		void unref();
 
 		// Destroy the packet and unref its data.
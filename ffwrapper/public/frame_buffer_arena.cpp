@@ -0,0 +1,349 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/imgutils.h>
+}
+
+#include "frame_buffer_arena.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <mutex>
+#include <vector>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace ff
+{
+	// Planes start at addresses of this alignment.
+	constexpr size_t arena_plane_alignment = 64;
+
+	constexpr size_t arena_page_size = 4096;
+	constexpr size_t arena_huge_page_size = 2 * 1024 * 1024;
+
+	struct arena_memory
+	{
+		uint8_t* base = nullptr;
+		size_t total_size = 0;
+		size_t slot_size = 0;
+		bool explicit_huge_pages = false;
+
+		// the largest frame a slot can take, after avcodec_align_dimensions2()
+		int max_width = 0, max_height = 0;
+
+		int num_planes = 0;
+		int linesizes[4] = { 0,0,0,0 };
+		size_t offsets[4] = { 0,0,0,0 };
+
+		// Slots are handed out through the pool so that libavutil recycles the AVBuffers that wrap them.
+		::AVBufferPool* pool = nullptr;
+
+		// Buffers are released by whichever thread drops the last reference.
+		std::mutex mutex;
+		std::vector<int> free_slots;
+	};
+}
+
+namespace
+{
+	// Allocates the memory of the arena. Sets explicit_huge_pages on success with them.
+	uint8_t* allocate_arena(size_t& size, ff::frame_buffer_arena::huge_page_mode mode, bool& explicit_huge_pages)
+	{
+		using page_mode = ff::frame_buffer_arena::huge_page_mode;
+		explicit_huge_pages = false;
+
+#if defined(_WIN32)
+		if (mode == page_mode::explicit_pages)
+		{
+			SIZE_T large_page = GetLargePageMinimum();
+			if (large_page != 0)
+			{
+				size_t large_size = FFALIGN(size, (size_t)large_page);
+				void* p = VirtualAlloc(nullptr, large_size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+				if (p)
+				{
+					size = large_size;
+					explicit_huge_pages = true;
+					return (uint8_t*)p;
+				}
+			}
+			// fall back to normal pages.
+		}
+
+		size = FFALIGN(size, ff::arena_page_size);
+		return (uint8_t*)VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#elif defined(__linux__)
+		if (mode == page_mode::explicit_pages)
+		{
+			size_t huge_size = FFALIGN(size, ff::arena_huge_page_size);
+			void* p = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (p != MAP_FAILED)
+			{
+				size = huge_size;
+				explicit_huge_pages = true;
+				return (uint8_t*)p;
+			}
+			// No huge pages reserved. Fall back to transparent ones.
+			mode = page_mode::transparent;
+		}
+
+		if (mode == page_mode::transparent)
+		{
+			// THP can only back whole, aligned huge pages.
+			size = FFALIGN(size, ff::arena_huge_page_size);
+		}
+		else
+		{
+			size = FFALIGN(size, ff::arena_page_size);
+		}
+
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+		{
+			return nullptr;
+		}
+
+		if (mode == page_mode::transparent)
+		{
+			// Only a hint. Ignore failures.
+			madvise(p, size, MADV_HUGEPAGE);
+		}
+
+		return (uint8_t*)p;
+#else
+		(void)mode;
+		size = FFALIGN(size, ff::arena_page_size);
+		// Huge pages are not supported here.
+		return (uint8_t*)av_malloc(size);
+#endif
+	}
+
+	void free_arena(uint8_t* base, size_t size)
+	{
+		if (!base)
+		{
+			return;
+		}
+
+#if defined(_WIN32)
+		(void)size;
+		VirtualFree(base, 0, MEM_RELEASE);
+#elif defined(__linux__)
+		munmap(base, size);
+#else
+		(void)size;
+		av_free(base);
+#endif
+	}
+
+	// Returns a slot to the arena. Called by libavutil when the AVBuffer of the slot is freed.
+	void release_slot(void* opaque, uint8_t* data)
+	{
+		auto* mem = static_cast<ff::arena_memory*>(opaque);
+
+		std::lock_guard<std::mutex> lock(mem->mutex);
+		mem->free_slots.push_back((int)((data - mem->base) / mem->slot_size));
+	}
+
+	// The alloc callback of the pool. Takes a free slot, or gives nullptr if all are in use.
+	::AVBufferRef* acquire_slot(void* opaque, size_t size)
+	{
+		auto* mem = static_cast<ff::arena_memory*>(opaque);
+
+		int slot = -1;
+		{
+			std::lock_guard<std::mutex> lock(mem->mutex);
+			if (mem->free_slots.empty())
+			{
+				return nullptr;
+			}
+			slot = mem->free_slots.back();
+			mem->free_slots.pop_back();
+		}
+
+		uint8_t* data = mem->base + (size_t)slot * mem->slot_size;
+		::AVBufferRef* ref = av_buffer_create(data, size, release_slot, mem, 0);
+		if (!ref)
+		{
+			release_slot(mem, data);
+		}
+
+		return ref;
+	}
+
+	// Called when the pool is uninited and all of its buffers are returned. Now the memory can go.
+	void free_arena_memory(void* opaque)
+	{
+		auto* mem = static_cast<ff::arena_memory*>(opaque);
+
+		free_arena(mem->base, mem->total_size);
+		delete mem;
+	}
+}
+
+ff::frame_buffer_arena::frame_buffer_arena(const ::AVCodecContext* ctx, const video_info& info) :
+	frame_buffer_arena(ctx, info, settings())
+{
+}
+
+ff::frame_buffer_arena::frame_buffer_arena(const ::AVCodecContext* ctx, const video_info& info, const settings& s) :
+	vinfo(info)
+{
+	if (!info.valid() || info.width <= 0 || info.height <= 0 || s.num_slots <= 0)
+	{
+		ON_FF_ERROR("Cannot create a frame buffer arena for an invalid video format.")
+	}
+
+	memory = new arena_memory();
+
+	// The codec may need more than the visible size, e.g. H.264 decodes in 16x16 macroblocks.
+	int w = info.width, h = info.height;
+	int linesize_align[AV_NUM_DATA_POINTERS];
+	avcodec_align_dimensions2(const_cast<::AVCodecContext*>(ctx), &w, &h, linesize_align);
+	memory->max_width = w;
+	memory->max_height = h;
+
+	int ret = 0;
+	if ((ret = av_image_fill_linesizes(memory->linesizes, (AVPixelFormat)info.pix_fmt, w)) < 0)
+	{
+		delete memory;
+		ON_FF_ERROR_WITH_CODE("Could not calculate the linesizes for the frame buffer arena.", ret)
+	}
+
+	ptrdiff_t aligned_linesizes[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		// 64 is a multiple of every linesize_align the codecs ask for.
+		memory->linesizes[i] = FFALIGN(memory->linesizes[i], (int)arena_plane_alignment);
+		aligned_linesizes[i] = memory->linesizes[i];
+	}
+
+	size_t sizes[4];
+	if ((ret = av_image_fill_plane_sizes(sizes, (AVPixelFormat)info.pix_fmt, h, aligned_linesizes)) < 0)
+	{
+		delete memory;
+		ON_FF_ERROR_WITH_CODE("Could not calculate the plane sizes for the frame buffer arena.", ret)
+	}
+
+	// Lay out the planes one after another in a slot, each starting at an aligned address
+	// and followed by the padding libavcodec may read past the end of a plane.
+	size_t offset = 0;
+	for (int i = 0; i < 4 && sizes[i] != 0; ++i)
+	{
+		memory->offsets[i] = offset;
+		offset += FFALIGN(sizes[i] + AV_INPUT_BUFFER_PADDING_SIZE, arena_plane_alignment);
+		++memory->num_planes;
+	}
+	memory->slot_size = offset;
+
+	size_t total_size = memory->slot_size * (size_t)s.num_slots;
+	memory->base = allocate_arena(total_size, s.huge_pages, memory->explicit_huge_pages);
+	if (!memory->base)
+	{
+		delete memory;
+		ON_FF_ERROR("Could not allocate the frame buffer arena.")
+	}
+	memory->total_size = total_size;
+
+	if (s.prefault)
+	{
+		std::memset(memory->base, 0, memory->total_size);
+	}
+
+	memory->free_slots.reserve(s.num_slots);
+	// Push in reverse so that slot 0 is used first.
+	for (int i = s.num_slots - 1; i >= 0; --i)
+	{
+		memory->free_slots.push_back(i);
+	}
+
+	memory->pool = av_buffer_pool_init2(memory->slot_size, memory, acquire_slot, free_arena_memory);
+	if (!memory->pool)
+	{
+		free_arena(memory->base, memory->total_size);
+		delete memory;
+		ON_FF_ERROR("Could not allocate the buffer pool of the frame buffer arena.")
+	}
+}
+
+ff::frame_buffer_arena::~frame_buffer_arena()
+{
+	// The memory will be freed by free_arena_memory once all frames using it are unrefed.
+	av_buffer_pool_uninit(&memory->pool);
+}
+
+bool ff::frame_buffer_arena::install(::AVCodecContext* ctx)
+{
+	if (!(ctx->codec && (ctx->codec->capabilities & AV_CODEC_CAP_DR1)))
+	{
+		return false;
+	}
+
+	ctx->opaque = this;
+	ctx->get_buffer2 = get_buffer2;
+
+	return true;
+}
+
+size_t ff::frame_buffer_arena::size() const
+{
+	return memory->total_size;
+}
+
+bool ff::frame_buffer_arena::uses_explicit_huge_pages() const
+{
+	return memory->explicit_huge_pages;
+}
+
+ff::frame_buffer_arena::statistics ff::frame_buffer_arena::get_statistics() const
+{
+	statistics stats;
+	stats.num_arena_frames = num_arena_frames.load();
+	stats.num_fallback_frames = num_fallback_frames.load();
+	return stats;
+}
+
+int ff::frame_buffer_arena::get_buffer2(::AVCodecContext* ctx, ::AVFrame* frame, int flags)
+{
+	return static_cast<frame_buffer_arena*>(ctx->opaque)->get_buffer(ctx, frame, flags);
+}
+
+int ff::frame_buffer_arena::get_buffer(::AVCodecContext* ctx, ::AVFrame* frame, int flags)
+{
+	auto* mem = memory;
+
+	bool fits = !ctx->hw_frames_ctx && frame->format == vinfo.pix_fmt;
+	if (fits)
+	{
+		int w = frame->width, h = frame->height;
+		int linesize_align[AV_NUM_DATA_POINTERS];
+		avcodec_align_dimensions2(ctx, &w, &h, linesize_align);
+
+		fits = w <= mem->max_width && h <= mem->max_height;
+	}
+
+	::AVBufferRef* buf = fits ? av_buffer_pool_get(mem->pool) : nullptr;
+	if (!buf)
+	{
+		++num_fallback_frames;
+		return avcodec_default_get_buffer2(ctx, frame, flags);
+	}
+
+	// One buffer holds all the planes.
+	frame->buf[0] = buf;
+	for (int i = 0; i < mem->num_planes; ++i)
+	{
+		frame->data[i] = buf->data + mem->offsets[i];
+		frame->linesize[i] = mem->linesizes[i];
+	}
+	frame->extended_data = frame->data;
+
+	++num_arena_frames;
+	return 0;
+}
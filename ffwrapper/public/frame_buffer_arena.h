@@ -0,0 +1,119 @@
+/*
+* frame_buffer_arena.h:
+* Defines an arena that serves the planes of decoded video frames from one preallocated block of memory.
+*/
+
+#pragma once
+
+#include "../private/utility/info.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct AVCodecContext;
+struct AVFrame;
+
+namespace ff
+{
+	/*
+	* A buffer provider for decoders, installed as AVCodecContext::get_buffer2.
+	*
+	* On construction, allocates (and by default touches) one block of memory large enough for num_slots frames of a video_info,
+	* so that decoding high resolution videos does not keep faulting in fresh pages.
+	* Each slot holds all planes of one frame; each plane starts at a 64-byte aligned address.
+	*
+	* Frames that do not fit in a slot (other format, larger size, hardware frames), or that are requested when all slots are in use,
+	* are allocated by libavcodec's default allocator.
+	*
+	* The memory stays alive until the arena is destroyed AND all frames that use it are unrefed,
+	* so decoded frames can safely outlive the decoder.
+	*/
+	class frame_buffer_arena
+	{
+	public:
+		enum class huge_page_mode
+		{
+			// Normal pages
+			none,
+			// Linux only: hints the kernel with madvise(MADV_HUGEPAGE) to back the arena with transparent huge pages.
+			transparent,
+			/*
+			* Linux: maps the arena with MAP_HUGETLB, which requires huge pages to be reserved (vm.nr_hugepages).
+			* Windows: allocates with MEM_LARGE_PAGES, which requires the SeLockMemoryPrivilege.
+			* Falls back to transparent (or to normal pages on Windows) if it fails.
+			*/
+			explicit_pages
+		};
+
+		struct settings
+		{
+			// number of frames the arena can hold at the same time.
+			// Should be larger than the number of frames the decoder keeps as references + the frame threads + the frames held by the user.
+			int num_slots = 16;
+			huge_page_mode huge_pages = huge_page_mode::none;
+			// Touches every page of the arena on construction so that no page faults happen during decoding.
+			bool prefault = true;
+		};
+
+		struct statistics
+		{
+			// number of frames served from the arena
+			uint64_t num_arena_frames = 0;
+			// number of frames passed on to the default allocator
+			uint64_t num_fallback_frames = 0;
+		};
+
+	public:
+		frame_buffer_arena() = delete;
+		/*
+		* Creates an arena for frames decoded by ctx of info.
+		* ctx is only used to calculate the padding the codec requires; it is not kept.
+		*
+		* @throws std::runtime_error on failure
+		*/
+		frame_buffer_arena(const ::AVCodecContext* ctx, const video_info& info, const settings& s);
+		// Uses the default settings.
+		frame_buffer_arena(const ::AVCodecContext* ctx, const video_info& info);
+
+		frame_buffer_arena(const frame_buffer_arena&) = delete;
+		frame_buffer_arena& operator=(const frame_buffer_arena&) = delete;
+
+		~frame_buffer_arena();
+
+	public:
+		/*
+		* Installs the arena as ctx's get_buffer2. Must be done before the codec is opened.
+		* @returns false if the codec does not support custom buffers (AV_CODEC_CAP_DR1), in which case nothing is done.
+		*/
+		bool install(::AVCodecContext* ctx);
+
+		/*
+		* Serves a frame the way the installed get_buffer2 does, for owners of a codec context that install
+		 a get_buffer2 of their own because they need ctx->opaque for something else.
+		* Requires: the codec context supports custom buffers (AV_CODEC_CAP_DR1).
+		*/
+		int get_buffer(::AVCodecContext* ctx, ::AVFrame* frame, int flags);
+
+		// @returns the size in bytes of the whole arena.
+		size_t size() const;
+
+		// @returns true iff the arena is actually backed by explicit huge pages.
+		bool uses_explicit_huge_pages() const;
+
+		statistics get_statistics() const;
+
+	private:
+		// The get_buffer2 callback. ctx->opaque is the arena.
+		static int get_buffer2(::AVCodecContext* ctx, ::AVFrame* frame, int flags);
+
+	private:
+		// The memory and the slot bookkeeping, which may outlive the arena. Defined in the cpp.
+		struct arena_memory* memory = nullptr;
+
+		video_info vinfo;
+
+		std::atomic<uint64_t> num_arena_frames{ 0 };
+		std::atomic<uint64_t> num_fallback_frames{ 0 };
+	};
+}
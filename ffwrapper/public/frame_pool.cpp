@@ -0,0 +1,190 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/cpu.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include "frame_pool.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+
+ff::frame_pool::frame_pool(const video_info& info, int alignment) : vinfo(info)
+{
+	if (!info.valid())
+	{
+		ON_FF_ERROR("Cannot create a frame pool for an invalid video format.")
+	}
+
+	// Lay out the planes the same way av_frame_get_buffer() does.
+	int align = alignment > 0 ? alignment : (int)av_cpu_max_align();
+
+	int ret = 0;
+	if ((ret = av_image_fill_linesizes(linesizes, (AVPixelFormat)info.pix_fmt, FFALIGN(info.width, align))) < 0)
+	{
+		ON_FF_ERROR_WITH_CODE("Could not calculate the linesizes for the frame pool.", ret)
+	}
+
+	ptrdiff_t aligned_linesizes[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		linesizes[i] = FFALIGN(linesizes[i], align);
+		aligned_linesizes[i] = linesizes[i];
+	}
+
+	size_t sizes[4];
+	// Some codecs read a little past the last line, so pad the height like libavutil does.
+	if ((ret = av_image_fill_plane_sizes(sizes, (AVPixelFormat)info.pix_fmt, FFALIGN(info.height, 32), aligned_linesizes)) < 0)
+	{
+		ON_FF_ERROR_WITH_CODE("Could not calculate the plane sizes for the frame pool.", ret)
+	}
+
+	for (int i = 0; i < 4 && sizes[i] != 0; ++i)
+	{
+		plane_sizes[i] = sizes[i] + 16 + align - 1;
+		++num_planes;
+	}
+
+	init_buffer_pools();
+}
+
+ff::frame_pool::frame_pool(const audio_info& info, int samples, int alignment) : ainfo(info), nb_samples(samples)
+{
+	if (!info.valid() || samples <= 0)
+	{
+		ON_FF_ERROR("Cannot create a frame pool for an invalid audio format.")
+	}
+
+	int nb_channels = info.ch_layout.nb_channels;
+	int ret = 0;
+	if ((ret = av_samples_get_buffer_size(&linesizes[0], nb_channels, samples, (AVSampleFormat)info.sample_fmt, alignment)) < 0)
+	{
+		ON_FF_ERROR_WITH_CODE("Could not calculate the buffer size for the frame pool.", ret)
+	}
+
+	num_planes = av_sample_fmt_is_planar((AVSampleFormat)info.sample_fmt) ? nb_channels : 1;
+	if (num_planes > max_planes)
+	{
+		ON_FF_ERROR("The frame pool does not support audio of so many planar channels.")
+	}
+
+	for (int i = 0; i < num_planes; ++i)
+	{
+		plane_sizes[i] = linesizes[0];
+	}
+
+	init_buffer_pools();
+}
+
+ff::frame_pool::~frame_pool()
+{
+	for (auto* shell : free_shells)
+	{
+		ffhelpers::safely_free_frame(&shell);
+	}
+
+	for (int i = 0; i < num_planes; ++i)
+	{
+		// The pool will actually be freed once all of its buffers are returned.
+		av_buffer_pool_uninit(&buffer_pools[i]);
+	}
+}
+
+ff::frame ff::frame_pool::acquire()
+{
+	++stats.num_acquisitions;
+
+	::AVFrame* shell = nullptr;
+	if (!free_shells.empty())
+	{
+		shell = free_shells.back();
+		free_shells.pop_back();
+	}
+	else
+	{
+		shell = av_frame_alloc();
+		if (!shell)
+		{
+			ON_FF_ERROR("Could not allocate AVFrame.")
+		}
+		++stats.num_frame_allocations;
+	}
+
+	// Let the frame take the shell now so that it won't leak if anything below throws.
+	ff::frame f(shell);
+
+	if (is_video())
+	{
+		shell->width = vinfo.width;
+		shell->height = vinfo.height;
+		shell->format = vinfo.pix_fmt;
+	}
+	else
+	{
+		shell->nb_samples = nb_samples;
+		shell->format = ainfo.sample_fmt;
+		shell->sample_rate = ainfo.sample_rate;
+
+		int ret = 0;
+		if ((ret = av_channel_layout_copy(&shell->ch_layout, &ainfo.ch_layout)) < 0)
+		{
+			ON_FF_ERROR_WITH_CODE("Could not copy channel layout", ret)
+		}
+	}
+
+	for (int i = 0; i < num_planes; ++i)
+	{
+		shell->buf[i] = av_buffer_pool_get(buffer_pools[i]);
+		if (!shell->buf[i])
+		{
+			ON_FF_ERROR("Could not get a buffer from the frame pool.")
+		}
+
+		shell->data[i] = shell->buf[i]->data;
+		// For audio, all planes have the same linesize, which is stored in linesizes[0].
+		shell->linesize[i] = is_video() ? linesizes[i] : linesizes[0];
+	}
+	shell->extended_data = shell->data;
+
+	return f;
+}
+
+void ff::frame_pool::release(ff::frame& f)
+{
+	if (!f.is_valid())
+	{
+		return;
+	}
+
+	// the planes go back to their buffer pools once nothing else references them.
+	av_frame_unref(f);
+
+	free_shells.push_back(f.buffer);
+	f.relinquish_ownership();
+}
+
+void ff::frame_pool::init_buffer_pools()
+{
+	for (int i = 0; i < num_planes; ++i)
+	{
+		buffer_pools[i] = av_buffer_pool_init2(plane_sizes[i], &stats, counted_alloc, nullptr);
+		if (!buffer_pools[i])
+		{
+			// free the ones already created
+			for (int j = 0; j < i; ++j)
+			{
+				av_buffer_pool_uninit(&buffer_pools[j]);
+			}
+			ON_FF_ERROR("Could not allocate the buffer pools of a frame pool.")
+		}
+	}
+}
+
+AVBufferRef* ff::frame_pool::counted_alloc(void* opaque, size_t size)
+{
+	++static_cast<statistics*>(opaque)->num_buffer_allocations;
+	return av_buffer_alloc(size);
+}
@@ -0,0 +1,119 @@
+/*
+* frame_pool.h:
+* Defines a pool that recycles frames of one fixed video/audio format.
+*/
+
+#pragma once
+
+#include "frame.h"
+#include "../private/utility/info.h"
+
+#include <vector>
+#include <cstdint>
+
+struct AVFrame;
+struct AVBufferPool;
+struct AVBufferRef;
+
+namespace ff
+{
+	/*
+	* A pool of frames that all have the same format, which is the key of the pool (a video_info, or an audio_info + nb_samples).
+	*
+	* Recycles two levels of storage:
+	* 1. The AVFrame shells, which are kept in a free list after they are released.
+	* 2. The data planes, which come from AVBufferPools (one per plane).
+	 When the last reference to a plane is dropped (e.g. by an encoder that has finished with it), it goes back to its pool automatically.
+	*
+	* Therefore, after a warm-up, acquire() and release() make no heap allocations of frames or planes.
+	* (libavutil still allocates a tiny AVBufferRef for each plane handed out, which is not counted here.)
+	*
+	* The shell free list is not thread-safe. The planes are, as AVBufferPool is.
+	*/
+	class frame_pool
+	{
+	public:
+		// Counters to see how much allocation the pool has actually done.
+		struct statistics
+		{
+			// number of AVFrame shells allocated
+			uint64_t num_frame_allocations = 0;
+			// number of plane buffers allocated by the AVBufferPools
+			uint64_t num_buffer_allocations = 0;
+			// number of calls to acquire()
+			uint64_t num_acquisitions = 0;
+		};
+
+	public:
+		frame_pool() = delete;
+		/*
+		* Creates a pool for video frames of info.
+		* @param alignment: the alignment of each line. 0 means it will be automatically choosen for the current cpu.
+		* @throws std::runtime_error on failure
+		*/
+		explicit frame_pool(const video_info& info, int alignment = 0);
+		/*
+		* Creates a pool for audio frames of info, each of which holds nb_samples samples per channel.
+		* @throws std::runtime_error on failure
+		*/
+		frame_pool(const audio_info& info, int nb_samples, int alignment = 0);
+
+		// Pools own AVBufferPools and cannot be copied.
+		frame_pool(const frame_pool&) = delete;
+		frame_pool& operator=(const frame_pool&) = delete;
+
+		// Frees all free shells and uninits the buffer pools.
+		// Planes still referenced elsewhere stay valid until they are unreferenced.
+		~frame_pool();
+
+	public:
+		/*
+		* @returns a frame of the pool's format with its buffer ready to be written.
+		* @throws std::runtime_error on failure
+		*/
+		ff::frame acquire();
+
+		/*
+		* Gives a frame back to the pool. Its data is unrefed and its shell is kept for later acquisitions.
+		* After this, f is invalid.
+		* The frame does not have to come from acquire(). Any frame can donate its shell.
+		*/
+		void release(ff::frame& f);
+		void release(ff::frame&& f) { release(f); }
+
+	public:
+		bool is_video() const { return vinfo.valid(); }
+		bool is_audio() const { return ainfo.valid(); }
+
+		// @returns true iff the pool gives frames of info.
+		bool matches(const video_info& info) const { return vinfo == info; }
+		// @returns true iff the pool gives frames of info and nb_samples.
+		bool matches(const audio_info& info, int samples) const { return ainfo == info && nb_samples == samples; }
+
+		const statistics& get_statistics() const { return stats; }
+
+	private:
+		// Allocates the AVBufferPools of the sizes in plane_sizes.
+		void init_buffer_pools();
+
+		// Counts the allocation and allocates a buffer for an AVBufferPool.
+		static struct ::AVBufferRef* counted_alloc(void* opaque, size_t size);
+
+	private:
+		video_info vinfo;
+		audio_info ainfo;
+		int nb_samples = 0;
+
+		// The same as AV_NUM_DATA_POINTERS. Formats that need more planes (audio of > 8 planar channels) are not supported.
+		static constexpr int max_planes = 8;
+
+		int num_planes = 0;
+		int linesizes[max_planes] = {};
+		size_t plane_sizes[max_planes] = {};
+		::AVBufferPool* buffer_pools[max_planes] = {};
+
+		std::vector<::AVFrame*> free_shells;
+
+		statistics stats;
+	};
+}
@@ -0,0 +1,331 @@
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "frame_server.h"
+#include "../private/ff_helpers.h"
+#include "../private/gop_helpers.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	// @returns the frame rate of the stream, or 0/1 if it's unknown.
+	AVRational frame_rate_of(const ff::input_stream& s)
+	{
+		if (s->avg_frame_rate.num > 0 && s->avg_frame_rate.den > 0)
+		{
+			return s->avg_frame_rate;
+		}
+		if (s->r_frame_rate.num > 0 && s->r_frame_rate.den > 0)
+		{
+			return s->r_frame_rate;
+		}
+		return AVRational{ 0, 1 };
+	}
+}
+
+ff::frame ff::frame_server::gop::frame_at(int64_t t) const
+{
+	if (frames.empty() || t >= end)
+	{
+		return ff::frame(nullptr);
+	}
+
+	// the first frame after t
+	auto it = std::upper_bound(frames.begin(), frames.end(), t,
+		[](int64_t t, const ff::frame& f) { return t < ffhelpers::frame_time(f); });
+
+	return it == frames.begin() ? *it : *(it - 1);
+}
+
+ff::frame_server::frame_server(const input_media& m, int i, size_t max_cached_gops, const decoder_options& opts) :
+	file(m),
+	stream_index(ffhelpers::choose_video_stream(m, i)),
+	stream(m.get_stream(stream_index)),
+	dem(m, ffhelpers::all_streams_but(m, stream_index)),
+	dec(dem.get_port(stream_index), opts),
+	max_gops(std::max<size_t>(max_cached_gops, 1))
+{
+	AVRational rate = frame_rate_of(stream);
+	if (rate.num > 0)
+	{
+		frame_duration = std::max<int64_t>(av_rescale_q(1, av_inv_q(rate), stream->time_base), 1);
+	}
+}
+
+int64_t ff::frame_server::frame_index_to_time(int64_t n) const
+{
+	AVRational rate = frame_rate_of(stream);
+	if (rate.num <= 0)
+	{
+		ON_FF_ERROR("The stream has no frame rate to locate frames by index.")
+	}
+
+	int64_t start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+	return start + av_rescale_q(n, av_inv_q(rate), stream->time_base);
+}
+
+ff::frame ff::frame_server::get_frame(int64_t n)
+{
+	if (n < 0)
+	{
+		return ff::frame(nullptr);
+	}
+	return get_frame_at(frame_index_to_time(n));
+}
+
+ff::frame ff::frame_server::get_frame_at(int64_t t)
+{
+	if (t >= stream_end)
+	{
+		return ff::frame(nullptr);
+	}
+	// Everything before the stream shows its first frame.
+	t = std::max(t, stream_begin);
+
+	if (const gop* g = find_cached(t))
+	{
+		return g->frame_at(t);
+	}
+
+	// If t is in the GOP that the decoder is about to decode, going on is cheaper than seeking.
+	bool seeked = false;
+	if (!positioned || keyframes.empty() || t < keyframes.front() || (keyframes.size() > 1 && t >= keyframes[1]))
+	{
+		seeked = true;
+	}
+	else if (file.get_keyframe_index().has_stream(stream_index))
+	{
+		const keyframe_index::entry* e = file.get_keyframe_index().find(stream_index, t);
+		seeked = !e || e->pts != keyframes.front();
+	}
+
+	int64_t target = t;
+	// demuxer::seek refuses times <= 0, and 1 lands on the first keyframe anyway.
+	bool from_start = target <= 1;
+	if (seeked && !seek_to(std::max<int64_t>(target, 1)))
+	{
+		return ff::frame(nullptr);
+	}
+
+	while (true)
+	{
+		gop decoded;
+		if (!decode_next_gop(decoded))
+		{
+			return ff::frame(nullptr);
+		}
+		const gop& g = cache_gop(std::move(decoded));
+
+		if (g.last)
+		{
+			stream_end = g.end;
+		}
+		if (seeked && from_start)
+		{
+			stream_begin = g.start;
+		}
+
+		if (g.contains(t) || (t < g.start && from_start))
+		{
+			return g.frame_at(t);
+		}
+
+		if (t < g.start)
+		{
+			// The container landed after t. Go back twice as far as we missed by until the start is reached.
+			target = ffhelpers::seek_back_target(target, g.start - target);
+			if (target <= 1)
+			{
+				from_start = true;
+			}
+			if (!seek_to(target))
+			{
+				return ff::frame(nullptr);
+			}
+			seeked = true;
+			continue;
+		}
+
+		if (g.last)
+		{
+			return ff::frame(nullptr);
+		}
+
+		// t is after the GOP. If we went on from the last position, t is too far ahead for that, so seek.
+		// If we have seeked, the container landed well before t and decoding on is what seeking would do anyway.
+		if (!seeked)
+		{
+			if (!seek_to(target))
+			{
+				return ff::frame(nullptr);
+			}
+			seeked = true;
+		}
+	}
+}
+
+void ff::frame_server::set_max_cached_gops(size_t n)
+{
+	max_gops = std::max<size_t>(n, 1);
+	while (cache.size() > max_gops)
+	{
+		cache.pop_back();
+	}
+}
+
+const ff::frame_server::gop* ff::frame_server::find_cached(int64_t t)
+{
+	for (auto it = cache.begin(); it != cache.end(); ++it)
+	{
+		if (it->contains(t))
+		{
+			cache.splice(cache.begin(), cache, it);
+			return &cache.front();
+		}
+	}
+	return nullptr;
+}
+
+const ff::frame_server::gop& ff::frame_server::cache_gop(gop&& g)
+{
+	// The same GOP may be decoded again if the container lands before it.
+	cache.remove_if([&g](const gop& cached) { return cached.start == g.start; });
+
+	cache.push_front(std::move(g));
+	while (cache.size() > max_gops)
+	{
+		cache.pop_back();
+	}
+	return cache.front();
+}
+
+bool ff::frame_server::seek_to(int64_t t)
+{
+	dec.flush_codec();
+	dem.get_port(stream_index).clear();
+	keyframes.clear();
+	pending = ff::frame(nullptr);
+	draining = false;
+	positioned = false;
+
+	if (dem.seek(t, stream_index) == -1)
+	{
+		return false;
+	}
+
+	// Decoding starts from the first keyframe.
+	while (keyframes.empty() && !draining)
+	{
+		feed_next_packet();
+	}
+
+	positioned = !keyframes.empty();
+	return positioned;
+}
+
+bool ff::frame_server::decode_next_gop(gop& g)
+{
+	if (!positioned)
+	{
+		return false;
+	}
+
+	g.start = keyframes.front();
+	g.frames.clear();
+
+	while (true)
+	{
+		ff::frame f(nullptr);
+		if (pending.is_valid())
+		{
+			f = std::move(pending);
+		}
+		else
+		{
+			status st = dec.receive(f);
+			if (st.again())
+			{
+				feed_next_packet();
+				continue;
+			}
+			else if (st.eof())
+			{
+				// That's the end of the stream.
+				positioned = false;
+				keyframes.clear();
+
+				g.last = true;
+				g.end = g.frames.empty() ? g.start + frame_duration : ffhelpers::frame_time(g.frames.back()) + frame_duration;
+				return true;
+			}
+			else if (st.is_error())
+			{
+				ON_FF_ERROR_WITH_CODE("Could not decode a frame to serve.", st.code)
+			}
+		}
+
+		int64_t pts = ffhelpers::frame_time(f);
+		if (keyframes.size() > 1 && pts >= keyframes[1])
+		{
+			// The first frame of the next GOP.
+			pending = std::move(f);
+			keyframes.pop_front();
+			g.end = keyframes.front();
+			return true;
+		}
+
+		// Leading frames of an open GOP that refer to frames before the seek.
+		if (pts < g.start)
+		{
+			continue;
+		}
+
+		g.frames.push_back(std::move(f));
+	}
+}
+
+void ff::frame_server::feed_next_packet()
+{
+	demuxer_port& port = dem.get_port(stream_index);
+
+	while (true)
+	{
+		ff::packet pkt(port.try_get_one());
+		if (!pkt.is_valid())
+		{
+			if (dem.demux_next_packet() == -1)
+			{
+				if (!draining)
+				{
+					dec.start_draining();
+					draining = true;
+				}
+				return;
+			}
+			continue;
+		}
+
+		bool key = pkt->flags & AV_PKT_FLAG_KEY;
+		// Nothing before the first keyframe can be decoded.
+		if (keyframes.empty() && !key)
+		{
+			continue;
+		}
+
+		int64_t ts = ffhelpers::packet_time(pkt);
+
+		ffhelpers::feed_requested_packet(dec, pkt, "Could not feed a packet to decode frames to serve.");
+
+		// A keyframe without any time cannot tell where a GOP ends.
+		if (key && (keyframes.empty() || ts != AV_NOPTS_VALUE))
+		{
+			keyframes.push_back(ts);
+		}
+		return;
+	}
+}
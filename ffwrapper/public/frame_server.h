@@ -0,0 +1,156 @@
+/*
+* frame_server.h:
+* Defines frame_server, which gives random access to the decoded frames of a video stream.
+*/
+
+#pragma once
+
+#include "media.h"
+#include "demuxer.h"
+#include "decoder.h"
+#include "frame.h"
+#include "ff_time.h"
+
+#include <list>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+namespace ff
+{
+	/*
+	* Serves the exact frame of a video stream at a time or a frame index.
+	*
+	* Frames are decoded a GOP at a time: from a keyframe to the frame before the next keyframe, in display order.
+	* The most recently used GOPs are kept in an LRU cache, so stepping forward or backward inside a GOP,
+	 or between cached GOPs, does no decoding at all.
+	* Asking for the GOP right after the last one decoded continues decoding from where it stopped instead of seeking.
+	*
+	* The server creates its own demuxer over the media, with every other stream unused.
+	* Thus, the media must not be demuxed by anything else while the server is alive.
+	*
+	* The returned frames share their data with the cached ones (see frame). Call make_writable() before modifying them.
+	*/
+	class frame_server
+	{
+	public:
+		frame_server() = delete;
+		/*
+		* Creates a server for stream i of m.
+		* @param i: the index of a video stream in m, or -1 for the best video stream.
+		* @param max_cached_gops: how many decoded GOPs are kept at most. At least 1.
+		* @param opts: settings of the decoder
+		*
+		* @throws std::runtime_error if the stream is not a video stream, or if the decoder cannot be created
+		*/
+		frame_server(const input_media& m, int i = -1, size_t max_cached_gops = 4, const decoder_options& opts = decoder_options());
+
+		frame_server(const frame_server&) = delete;
+		frame_server& operator=(const frame_server&) = delete;
+
+	public:
+		/*
+		* Gets the frame that is shown at time t, which is the last frame whose pts is at or before t.
+		* @param t: the time in the time base of the stream
+		*
+		* @returns the frame, which is the first frame of the stream if t is before it,
+		 or an invalid frame if t is after the end of the stream.
+		* @throws std::runtime_error on failure
+		*/
+		ff::frame get_frame_at(int64_t t);
+
+		/*
+		* Gets the frame of index n, counted from 0 at the start of the stream.
+		* Assumes that the stream is of a constant frame rate, as containers do not record where frame n is.
+		*
+		* @returns the frame, or an invalid frame if n is beyond the end of the stream.
+		* @throws std::runtime_error on failure, or if the stream has no frame rate
+		*/
+		ff::frame get_frame(int64_t n);
+
+		/*
+		* @returns the time at which frame n is shown, in the time base of the stream, assuming a constant frame rate.
+		* @throws std::runtime_error if the stream has no frame rate
+		*/
+		int64_t frame_index_to_time(int64_t n) const;
+
+	public:
+		int get_stream_index() const { return stream_index; }
+		ff::time get_time_base() const { return stream.get_time_base(); }
+
+		size_t num_cached_gops() const { return cache.size(); }
+		size_t get_max_cached_gops() const { return max_gops; }
+		// Shrinks the cache at once if it has more GOPs than n.
+		void set_max_cached_gops(size_t n);
+
+		// Drops every cached GOP.
+		void clear_cache() { cache.clear(); }
+
+	private:
+		// The frames of a keyframe and of everything shown after it before the next keyframe.
+		struct gop
+		{
+			// the pts of the keyframe
+			int64_t start = 0;
+			// the pts of the next keyframe, or the end of the last frame of the stream.
+			int64_t end = 0;
+			// true iff it's the last GOP of the stream
+			bool last = false;
+			// in ascending order of pts
+			std::vector<ff::frame> frames;
+
+			bool contains(int64_t t) const { return t >= start && t < end; }
+			// @returns the last frame at or before t, or the first frame if t is before it, or an invalid frame if t is after the end.
+			ff::frame frame_at(int64_t t) const;
+		};
+
+	private:
+		// @returns the cached GOP containing t and moves it to the front, or nullptr if there is none.
+		const gop* find_cached(int64_t t);
+
+		// Puts g at the front of the cache, evicting the least recently used GOP if it's full.
+		const gop& cache_gop(gop&& g);
+
+		/*
+		* Seeks to the keyframe at or before t, and restarts decoding from there.
+		* @returns false if there's nothing to decode from there.
+		*/
+		bool seek_to(int64_t t);
+
+		// Decodes the GOP starting from the next keyframe of the decoding position.
+		// @returns false if the stream has no more GOPs.
+		bool decode_next_gop(gop& g);
+
+		// Feeds the next packet of the stream to the decoder, or starts draining at the end of the stream.
+		void feed_next_packet();
+
+	private:
+		const input_media& file;
+		int stream_index = -1;
+		input_stream stream;
+
+		demuxer dem;
+		input_decoder dec;
+
+		size_t max_gops;
+		// The front is the most recently used.
+		std::list<gop> cache;
+
+		// How long a frame is shown, from the frame rate. 1 if the stream has no frame rate.
+		int64_t frame_duration = 1;
+		// The pts of the first frame and the end of the last frame, once they are known.
+		int64_t stream_begin = std::numeric_limits<int64_t>::min();
+		int64_t stream_end = std::numeric_limits<int64_t>::max();
+
+		// The decoding position.
+		// true iff the decoder can go on to the next GOP without seeking.
+		bool positioned = false;
+		// true iff the decoder is draining
+		bool draining = false;
+		// pts of the keyframes fed to the decoder whose GOPs are not complete yet. The front is the GOP being decoded.
+		std::deque<int64_t> keyframes;
+		// A frame already decoded that belongs to the next GOP.
+		ff::frame pending{ nullptr };
+	};
+}
@@ -0,0 +1,370 @@
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "gop_parallel_decoder.h"
+#include "demuxer.h"
+#include "decoder_pool.h"
+#include "../private/ff_helpers.h"
+#include "../private/gop_helpers.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <system_error>
+
+ff::gop_parallel_decoder::gop_parallel_decoder(const std::string& fp, int i) :
+	gop_parallel_decoder(fp, i, settings())
+{
+}
+
+ff::gop_parallel_decoder::gop_parallel_decoder(const std::string& fp, int i, const settings& s) :
+	filepath(fp), opts(s), file(fp, s.input)
+{
+	stream_index = ffhelpers::choose_video_stream(file, i);
+
+	if (opts.num_workers <= 0)
+	{
+		opts.num_workers = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	range_capacity = std::max<size_t>(opts.window_frames / opts.num_workers, 1);
+
+	plan_ranges();
+	// More workers than ranges would have nothing to do.
+	opts.num_workers = std::min(opts.num_workers, std::max((int)ranges.size(), 1));
+
+	try
+	{
+		for (int w = 0; w != opts.num_workers; ++w)
+		{
+			workers.emplace_back(&gop_parallel_decoder::worker_loop, this);
+		}
+	}
+	catch (const std::system_error& e)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		frame_taken.notify_all();
+		for (auto& t : workers)
+		{
+			t.join();
+		}
+		ON_FF_ERROR(std::string("Could not start the workers to decode GOPs. ") + e.what())
+	}
+}
+
+ff::gop_parallel_decoder::~gop_parallel_decoder()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	frame_taken.notify_all();
+	frame_put.notify_all();
+
+	for (auto& t : workers)
+	{
+		t.join();
+	}
+}
+
+ff::time ff::gop_parallel_decoder::get_time_base() const
+{
+	return file.get_stream(stream_index).get_time_base();
+}
+
+ff::gop_parallel_decoder::statistics ff::gop_parallel_decoder::get_statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void ff::gop_parallel_decoder::plan_ranges()
+{
+	if (!file.get_keyframe_index().has_stream(stream_index))
+	{
+		// Reads the whole file once. The sidecar saves it next time.
+		file.build_keyframe_index(true);
+	}
+
+	std::vector<int64_t> keyframes;
+	if (file.get_keyframe_index().has_stream(stream_index))
+	{
+		for (const auto& e : file.get_keyframe_index().get_entries(stream_index))
+		{
+			int64_t t = e.pts != AV_NOPTS_VALUE ? e.pts : e.dts;
+			if (t != AV_NOPTS_VALUE && (keyframes.empty() || t > keyframes.back()))
+			{
+				keyframes.push_back(t);
+			}
+		}
+	}
+
+	if (keyframes.empty())
+	{
+		// Nothing to cut at. A single worker decodes everything.
+		range r;
+		r.keyframe = 1;
+		r.start = std::numeric_limits<int64_t>::min();
+		r.end = std::numeric_limits<int64_t>::max();
+		ranges.push_back(std::move(r));
+		stats.num_ranges = ranges.size();
+		return;
+	}
+
+	// Put as many GOPs into a range as fit into its share of the window.
+	size_t gops_per_range = 1;
+	input_stream s = file.get_stream(stream_index);
+	AVRational rate = s->avg_frame_rate.num > 0 && s->avg_frame_rate.den > 0 ? s->avg_frame_rate : s->r_frame_rate;
+	if (keyframes.size() > 1 && rate.num > 0 && rate.den > 0)
+	{
+		// in the time base of the stream
+		double frame_duration = av_q2d(av_inv_q(rate)) / av_q2d(s->time_base);
+		double frames_per_gop = (double)(keyframes.back() - keyframes.front()) / (keyframes.size() - 1) / frame_duration;
+		if (frames_per_gop >= 1.0)
+		{
+			gops_per_range = std::max<size_t>((size_t)(range_capacity / frames_per_gop), 1);
+		}
+	}
+
+	for (size_t k = 0; k < keyframes.size(); k += gops_per_range)
+	{
+		range r;
+		r.keyframe = keyframes[k];
+		// Whatever is shown before the first keyframe belongs to the first range.
+		r.start = k == 0 ? std::numeric_limits<int64_t>::min() : keyframes[k];
+		r.end = k + gops_per_range < keyframes.size() ? keyframes[k + gops_per_range] : std::numeric_limits<int64_t>::max();
+		ranges.push_back(std::move(r));
+	}
+	stats.num_ranges = ranges.size();
+}
+
+void ff::gop_parallel_decoder::worker_loop()
+{
+	try
+	{
+		input_media m(filepath, opts.input);
+		// The index is not changed after construction, so it's safe to copy while other workers do.
+		m.set_keyframe_index(file.get_keyframe_index());
+
+		demuxer dem(m, ffhelpers::all_streams_but(m, stream_index));
+		std::unique_ptr<input_decoder> dec = decoder_pool::instance().acquire(dem.get_port(stream_index), opts.decoder);
+
+		while (true)
+		{
+			size_t r = 0;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				// Only start ranges that the window has room for.
+				frame_taken.wait(lock, [this]()
+					{
+						return stopping || next_range >= ranges.size() || next_range < head + (size_t)opts.num_workers;
+					});
+				if (stopping || next_range >= ranges.size())
+				{
+					break;
+				}
+				r = next_range++;
+			}
+
+			decode_range(r, dem, *dec);
+		}
+
+		decoder_pool::instance().release(std::move(dec));
+	}
+	catch (...)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+			{
+				error = std::current_exception();
+			}
+			stopping = true;
+		}
+		frame_put.notify_all();
+		frame_taken.notify_all();
+	}
+}
+
+void ff::gop_parallel_decoder::decode_range(size_t r, demuxer& dem, input_decoder& dec)
+{
+	// Only the frames and done of a range change after planning.
+	const int64_t keyframe = ranges[r].keyframe, start = ranges[r].start, end = ranges[r].end;
+	demuxer_port& port = dem.get_port(stream_index);
+
+	// Seek to the keyframe. If the container lands after it, go back twice as far as it missed by.
+	int64_t target = std::max<int64_t>(keyframe, 1);
+	ff::packet first(nullptr);
+	while (true)
+	{
+		dec.flush_codec();
+		port.clear();
+		if (dem.seek(target, stream_index) == -1)
+		{
+			ON_FF_ERROR("Could not seek to a range of GOPs to decode.")
+		}
+
+		first = port.try_get_one();
+		int64_t landed = first.is_valid() ? ffhelpers::packet_time(first) : AV_NOPTS_VALUE;
+		if (target <= 1 || landed == AV_NOPTS_VALUE || landed <= keyframe)
+		{
+			break;
+		}
+		target = ffhelpers::seek_back_target(target, landed - keyframe);
+	}
+
+	bool started = false, draining = false;
+	ff::frame f(nullptr);
+	while (true)
+	{
+		status st = dec.receive(f);
+		if (st.ok())
+		{
+			int64_t t = ffhelpers::frame_time(f);
+			if (t >= end)
+			{
+				// Frames come out in order, so the range is complete.
+				break;
+			}
+			if (t < start)
+			{
+				// A leading frame of an open GOP, which the worker of the range before has decoded.
+				std::lock_guard<std::mutex> lock(mutex);
+				++stats.num_dropped_frames;
+				continue;
+			}
+			if (!put_frame(r, std::move(f)))
+			{
+				return;
+			}
+			continue;
+		}
+		else if (st.eof())
+		{
+			break;
+		}
+		else if (!st.again())
+		{
+			ON_FF_ERROR_WITH_CODE("Could not decode a frame of a range of GOPs.", st.code)
+		}
+
+		if (draining)
+		{
+			break;
+		}
+
+		// The decoder needs the next packet.
+		ff::packet pkt(nullptr);
+		if (first.is_valid())
+		{
+			pkt = std::move(first);
+		}
+		else
+		{
+			pkt = port.try_get_one();
+			if (!pkt.is_valid())
+			{
+				if (dem.demux_next_packet() == -1)
+				{
+					dec.start_draining();
+					draining = true;
+				}
+				continue;
+			}
+		}
+
+		// Nothing before the first keyframe can be decoded.
+		if (!started && !(pkt->flags & AV_PKT_FLAG_KEY))
+		{
+			continue;
+		}
+		started = true;
+
+		ffhelpers::feed_requested_packet(dec, pkt, "Could not feed a packet to decode a range of GOPs.");
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ranges[r].done = true;
+	}
+	frame_put.notify_all();
+}
+
+bool ff::gop_parallel_decoder::put_frame(size_t r, ff::frame&& f)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		auto wait_start = std::chrono::steady_clock::now();
+		frame_taken.wait(lock, [this, r]() { return stopping || ranges[r].frames.size() < range_capacity; });
+		stats.worker_wait_time += std::chrono::steady_clock::now() - wait_start;
+
+		if (stopping)
+		{
+			return false;
+		}
+		ranges[r].frames.push_back(std::move(f));
+	}
+	frame_put.notify_all();
+	return true;
+}
+
+ff::frame ff::gop_parallel_decoder::get_one(std::unique_lock<std::mutex>& lock, bool wait)
+{
+	while (true)
+	{
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+		if (head >= ranges.size())
+		{
+			return ff::frame(nullptr);
+		}
+
+		range& r = ranges[head];
+		if (!r.frames.empty())
+		{
+			ff::frame f = std::move(r.frames.front());
+			r.frames.pop_front();
+			frame_taken.notify_all();
+			return f;
+		}
+		if (r.done)
+		{
+			// The next range may start now.
+			++head;
+			frame_taken.notify_all();
+			continue;
+		}
+
+		if (!wait)
+		{
+			return ff::frame(nullptr);
+		}
+		frame_put.wait(lock);
+	}
+}
+
+ff::frame ff::gop_parallel_decoder::wait_and_get_one()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return get_one(lock, true);
+}
+
+ff::frame ff::gop_parallel_decoder::try_get_one()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return get_one(lock, false);
+}
+
+bool ff::gop_parallel_decoder::eof() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return head >= ranges.size();
+}
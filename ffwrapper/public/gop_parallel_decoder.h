@@ -0,0 +1,172 @@
+/*
+* gop_parallel_decoder.h:
+* Defines gop_parallel_decoder, which decodes ranges of GOPs of one video stream in parallel.
+*/
+
+#pragma once
+
+#include "media.h"
+#include "decoder.h"
+#include "frame.h"
+#include "ff_time.h"
+#include "interfaces/src_sink.h"
+
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace ff
+{
+	/*
+	* Decodes a video stream of a file with several workers, each of which has its own input_media, demuxer and decoder,
+	 and decodes a range of GOPs of its own. The frames come out in the order of their pts.
+	*
+	* Frame threading stops scaling at around 8 threads, while GOPs of a stream can be decoded independently
+	 given a seek to their first keyframe. This is meant for analysis and transcoding, where the throughput matters:
+	 nothing comes out until the first range is decoded, and a worker stalls when its range is far ahead of the consumer.
+	*
+	* The ranges are cut at the keyframes of the keyframe_index of the file, which is built and saved as a sidecar
+	 if there is none yet. A worker decodes from the keyframe of its range until a frame shows at or after
+	 the start of the next range, so the leading frames of open GOPs are decoded by the worker of the range before,
+	 which has their references. The next worker drops them.
+	*
+	* The decoded frames waiting to be taken are bounded by settings::window_frames. Each range holds an equal share,
+	 and the ranges are sized to have about that many frames. A GOP longer than the share makes its worker wait
+	 for the consumer, which costs parallelism but not memory.
+	*/
+	class gop_parallel_decoder : public frame_source
+	{
+	public:
+		struct settings
+		{
+			// The number of workers. 0 for one per core.
+			int num_workers = 0;
+			// The most decoded frames held for putting them in order, over all workers.
+			size_t window_frames = 256;
+
+			// How each worker opens the file. Use the probe cache to open it faster.
+			input_options input;
+			// The decoder of each worker. Frame threading is seldom worth it on top of the workers.
+			decoder_options decoder;
+		};
+
+		struct statistics
+		{
+			size_t num_ranges = 0;
+			// the frames the workers decoded but dropped, as they belong to the range before
+			uint64_t num_dropped_frames = 0;
+			// total time the workers waited for the consumer
+			std::chrono::nanoseconds worker_wait_time{ 0 };
+		};
+
+	public:
+		gop_parallel_decoder() = delete;
+		/*
+		* Starts decoding stream i of the file at fp.
+		* @param i: the index of a video stream, or -1 for the best video stream.
+		*
+		* @throws std::runtime_error if the file cannot be opened, if the stream is not a video stream,
+		 or if the keyframe index cannot be built or the workers cannot be started
+		*/
+		gop_parallel_decoder(const std::string& fp, int i, const settings& s);
+		// Uses the default settings.
+		explicit gop_parallel_decoder(const std::string& fp, int i = -1);
+
+		gop_parallel_decoder(const gop_parallel_decoder&) = delete;
+		gop_parallel_decoder& operator=(const gop_parallel_decoder&) = delete;
+
+		// Stops the workers.
+		~gop_parallel_decoder();
+
+	public:
+		/*
+		* Waits for the next frame.
+		* @returns the frame, or an invalid frame after the last one.
+		* @throws std::runtime_error if a worker failed
+		*/
+		ff::frame wait_and_get_one();
+
+		/*
+		* Gets the next frame if it's decoded already.
+		* @returns the frame, or an invalid frame if it's not decoded yet, or after the last one (see eof()).
+		* @throws std::runtime_error if a worker failed
+		*/
+		ff::frame try_get_one() override;
+
+		// @returns true iff every frame has been taken.
+		bool eof() const;
+
+	public:
+		int get_stream_index() const { return stream_index; }
+		ff::time get_time_base() const;
+
+		// @returns the media the decoder probed the file with, which is not demuxed.
+		const input_media& get_media() const { return file; }
+
+		statistics get_statistics() const;
+
+	private:
+		// The frames shown from one keyframe up to another.
+		struct range
+		{
+			// the pts of the first keyframe, which the worker seeks to
+			int64_t keyframe = 0;
+			// Frames at or after start and before end belong to the range.
+			int64_t start = 0;
+			int64_t end = 0;
+
+			std::deque<ff::frame> frames;
+			// true iff the worker has put every frame of the range
+			bool done = false;
+		};
+
+	private:
+		// Cuts the stream into ranges at the keyframes.
+		void plan_ranges();
+
+		// The body of each worker.
+		void worker_loop();
+
+		// Decodes range r with the demuxer and the decoder of the worker.
+		void decode_range(size_t r, class demuxer& dem, input_decoder& dec);
+
+		// Puts f into range r, waiting for room. @returns false if the decoder is stopping.
+		bool put_frame(size_t r, ff::frame&& f);
+
+		/*
+		* Takes the next frame out, waiting for it if wait.
+		* Requires: the mutex is locked by lock.
+		*/
+		ff::frame get_one(std::unique_lock<std::mutex>& lock, bool wait);
+
+	private:
+		std::string filepath;
+		int stream_index = -1;
+		settings opts;
+		input_media file;
+
+		std::vector<range> ranges;
+		size_t range_capacity = 1;
+
+		std::vector<std::thread> workers;
+
+		mutable std::mutex mutex;
+		// notified when a frame is put or a range is done
+		std::condition_variable frame_put;
+		// notified when a frame is taken or a range is finished with
+		std::condition_variable frame_taken;
+		// the next range a worker should decode
+		size_t next_range = 0;
+		// the range the consumer takes frames from
+		size_t head = 0;
+		bool stopping = false;
+		std::exception_ptr error;
+
+		statistics stats;
+	};
+}
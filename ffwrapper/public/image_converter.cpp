@@ -50,5 +50,7 @@ ff::image_converter::~image_converter()
 
 void ff::image_converter::convert(frame & src, frame & dst)
 {
+	// dst may share its planes with other frames. They are all overwritten, so there is nothing to copy.
+	dst.make_writable_without_copy();
 	sws_scale(sws_ctx, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
 }
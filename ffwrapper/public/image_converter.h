@@ -33,6 +33,7 @@ namespace ff
 		bool is_ready() const { return sws_ctx != nullptr; }
 		/*
 		* Converts src to dst in the way instructed in the constructor.
+		* If dst's buffer is shared with other frames, then dst gets new planes of its own first (see frame::make_writable_without_copy()).
 		* @throws std::runtime_error is an unexpected error occurs.
 		*/
 		void convert(struct frame& src, struct frame& dst);
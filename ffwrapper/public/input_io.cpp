@@ -0,0 +1,58 @@
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include "input_io.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+
+ff::input_io::~input_io()
+{
+	ffhelpers::safely_free_custom_avio_context(&avio_ctx);
+}
+
+::AVIOContext* ff::input_io::get_avio_context()
+{
+	if (avio_ctx)
+	{
+		return avio_ctx;
+	}
+
+	int buf_size = buffer_size();
+	auto buf = (unsigned char*)av_malloc(buf_size);
+	if (!buf)
+	{
+		ON_FF_ERROR("Could not allocate the buffer of the I/O context.")
+	}
+
+	avio_ctx = avio_alloc_context(buf, buf_size, 0, this, &input_io::read_callback, nullptr, &input_io::seek_callback);
+	if (!avio_ctx)
+	{
+		av_free(buf);
+		ON_FF_ERROR("Could not allocate the I/O context.")
+	}
+	avio_ctx->seekable = seekable() ? AVIO_SEEKABLE_NORMAL : 0;
+
+	return avio_ctx;
+}
+
+int ff::input_io::read_callback(void* opaque, uint8_t* buf, int size)
+{
+	return static_cast<input_io*>(opaque)->read(buf, size);
+}
+
+int64_t ff::input_io::seek_callback(void* opaque, int64_t offset, int whence)
+{
+	auto io = static_cast<input_io*>(opaque);
+
+	// ffmpeg asks for the size this way.
+	if (whence & AVSEEK_SIZE)
+	{
+		return io->size();
+	}
+
+	// AVSEEK_FORCE only asks to seek even if it's expensive.
+	return io->seek(offset, whence & ~AVSEEK_FORCE);
+}
@@ -0,0 +1,78 @@
+/*
+* input_io.h:
+* Defines the base class of custom byte sources that an input_media can be demuxed from,
+* instead of the file protocol of ffmpeg.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct AVIOContext;
+
+namespace ff
+{
+	/*
+	* A source of bytes behind an input_media.
+	*
+	* Subclasses implement read(), seek() and size(). ffmpeg reads through the AVIOContext made by get_avio_context(),
+	* which calls them.
+	* Once an input_media is loaded from an input_io, it owns it.
+	*/
+	class input_io
+	{
+	public:
+		input_io() = default;
+
+		input_io(const input_io&) = delete;
+		input_io& operator=(const input_io&) = delete;
+
+		// Frees the AVIOContext.
+		virtual ~input_io();
+
+	public:
+		/*
+		* Reads at most size bytes into buf.
+		* @returns the number of bytes read, AVERROR_EOF at the end, or another negative AVERROR code on failure.
+		*/
+		virtual int read(uint8_t* buf, int size) = 0;
+
+		/*
+		* Moves the position to offset, relative to whence (SEEK_SET, SEEK_CUR or SEEK_END).
+		* @returns the new position, or a negative AVERROR code if it cannot move there.
+		*/
+		virtual int64_t seek(int64_t offset, int whence) = 0;
+
+		// @returns the total number of bytes, or a negative AVERROR code if it's unknown.
+		virtual int64_t size() const = 0;
+
+		// @returns false if seek() only works in a limited range, so that ffmpeg avoids seeking when it can.
+		virtual bool seekable() const { return true; }
+
+		// @returns the number of bytes ffmpeg asks read() for at a time.
+		virtual int buffer_size() const { return default_buffer_size; }
+
+		// @returns the location of the bytes, used as the url of the format context. May be empty.
+		virtual std::string url() const { return std::string(); }
+
+	public:
+		/*
+		* Creates the AVIOContext on the first call. It's owned by this.
+		* @throws std::runtime_error on failure
+		*/
+		::AVIOContext* get_avio_context();
+
+	protected:
+		// the buffer size of the file protocol of ffmpeg
+		static constexpr int default_buffer_size = 32 * 1024;
+
+	private:
+		// Callbacks of the AVIOContext. opaque is the input_io.
+		static int read_callback(void* opaque, uint8_t* buf, int size);
+		static int64_t seek_callback(void* opaque, int64_t offset, int whence);
+
+	private:
+		::AVIOContext* avio_ctx = nullptr;
+	};
+}
@@ -1,6 +1,6 @@
 /*
 * queue_src.h
-* 
+*
 * Defines queue sources that use queues to buffer elements so that the user know more about if elements are available and how many.
 */
 
@@ -8,12 +8,53 @@
 
 #include "src_sink.h"
 
-#include <queue>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 namespace ff
 {
+	/*
+	* What a queue source of limited capacity does with an element that arrives when it's full.
+	*/
+	enum class overflow_policy
+	{
+		/*
+		* The producer waits until the consumer takes an element out.
+		* Only use it when the consumer is on another thread, or the producer will wait forever.
+		*/
+		block,
+		// The element is rejected and left to the producer, which usually discards it.
+		drop,
+		// The element is kept in an unbounded spill queue behind the ring, and moves into the ring when there is room.
+		spill
+	};
+
+	/*
+	* How long the two ends of a queue source have waited for each other.
+	* If the consumer waits a lot, the producer is the bottleneck (e.g. a demuxer waiting on I/O);
+	* if the producer waits a lot, the consumer is (e.g. a decoder or an encoder).
+	*/
+	struct queue_wait_statistics
+	{
+		// total time spent in wait_and_get_one() waiting for an element
+		std::chrono::nanoseconds consumer_wait{ 0 };
+		// total time spent in push() waiting for room, under overflow_policy::block
+		std::chrono::nanoseconds producer_wait{ 0 };
+	};
+
 	/*
 	* Uses a queue to buffer elements so that the user know more about if elements are available and how many.
+	*
+	* The queue is a ring buffer. By default its capacity is unlimited: it grows (doubling its capacity) and never shrinks,
+	* so that once it is large enough, buffering elements does not allocate memory anymore.
+	* After set_capacity(), it holds at most that many elements and handles the rest according to its overflow_policy.
+	*
+	* All methods are synchronized, so one thread can produce while another consumes.
 	*/
 	template <typename T>
 	class queue_source : public source<T>
@@ -24,33 +65,88 @@ namespace ff
 
 	public:
 		queue_source() = default;
+		// The mutex and the condition variables are not copied.
+		queue_source(const queue_source& other)
+		{
+			std::lock_guard<std::mutex> lock(other.mutex);
+			copy_from(other);
+		}
+		queue_source(queue_source&& other) noexcept
+		{
+			std::lock_guard<std::mutex> lock(other.mutex);
+			move_from(other);
+		}
 		virtual ~queue_source() = default;
 
 		/*
 		* Tries to extract the first available element.
-		* 
+		*
 		* If !empty(), then this method always succeeds.
 		*/
 		T try_get_one() override
 		{
-			if (!empty())
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (count != 0)
 			{
-				T ret{ queue.front().buffer };
-				queue.front().relinquish_ownership();
+				T ret{ pop_front() };
 
-				queue.pop();
+				lock.unlock();
+				not_full.notify_one();
 				return ret;
 			}
 
-			return T();
+			return T(nullptr);
+		}
+
+		/*
+		* Waits until an element is available and extracts it.
+		* @returns the element, or an invalid element if the queue is closed and empty (i.e. no more will come).
+		*/
+		T wait_and_get_one()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (count == 0 && !closed)
+			{
+				auto start = std::chrono::steady_clock::now();
+				not_empty.wait(lock, [this]() { return count != 0 || closed; });
+				wait_stats.consumer_wait += std::chrono::steady_clock::now() - start;
+			}
+
+			return pop_after_wait(lock);
+		}
+
+		/*
+		* Waits at most timeout until an element is available and extracts it.
+		* @returns the element, or an invalid element if the time is out, or if the queue is closed and empty.
+		* Check is_closed() to tell the two apart.
+		*/
+		template <typename Rep, typename Period>
+		T wait_and_get_one(std::chrono::duration<Rep, Period> timeout)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (count == 0 && !closed)
+			{
+				auto start = std::chrono::steady_clock::now();
+				not_empty.wait_for(lock, timeout, [this]() { return count != 0 || closed; });
+				wait_stats.consumer_wait += std::chrono::steady_clock::now() - start;
+			}
+
+			return pop_after_wait(lock);
 		}
 
 		/*
 		* Note: even if the size is 0, it doesn't mean there will not be elements available here in the future.
-		* 
-		* @returns the number of elements current available in the source.
+		*
+		* @returns the number of elements current available in the source, including those spilled.
 		*/
-		auto size() const { return queue.size(); }
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return count + spilled.size();
+		}
 		// @returns true iff size() == 0.
 		bool empty() const { return size() == 0; }
 
@@ -60,22 +156,315 @@ namespace ff
 		*/
 		virtual const T& peek_first() const
 		{
-			return queue.front();
+			std::lock_guard<std::mutex> lock(mutex);
+			return ring[head];
 		}
 
 		/*
 		* Discards all currently available elements.
+		* The memory of the ring itself is kept for later use.
 		*/
 		virtual void clear()
 		{
-			// this will call the destructor of queue and destroy it.
-			std::queue<T>().swap(queue);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				for (; count != 0; --count)
+				{
+					ring[head].destroy();
+					head = (head + 1) % ring.size();
+				}
+				head = 0;
+
+				spilled.clear();
+			}
+			not_full.notify_all();
+		}
+
+	public:
+		/*
+		* Limits the number of elements the ring can hold.
+		* @param cap: the capacity. 0 means unlimited, which is the default.
+		* @param policy: what to do with elements that arrive when the ring is full.
+		*
+		* If there are more than cap elements now, the extra ones are spilled, whatever the policy is, so that none is lost.
+		* Spilled elements move into whatever room there is now, so that they stay ahead of later ones.
+		* Allocates the ring, so later pushes do not.
+		*/
+		void set_capacity(size_t cap, overflow_policy policy = overflow_policy::spill)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				max_count = cap;
+				overflow = policy;
+
+				if (cap != 0)
+				{
+					// extra elements go to the front of the spill queue, as they are before the ones already spilled.
+					while (count > cap)
+					{
+						size_t last = (head + count - 1) % ring.size();
+						spilled.emplace_front(std::move(ring[last]));
+						--count;
+					}
+					resize_ring(cap);
+				}
+				else
+				{
+					resize_ring(std::max(ring.size(), count + spilled.size()));
+				}
+
+				// Keeps the ring full while anything is spilled, so that pushes never get ahead of spilled elements.
+				while (!spilled.empty() && count < ring.size())
+				{
+					ring[(head + count) % ring.size()] = std::move(spilled.front());
+					spilled.pop_front();
+					++count;
+				}
+			}
+			not_full.notify_all();
+		}
+
+		// @returns the capacity. 0 means unlimited.
+		size_t capacity() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return max_count;
+		}
+
+		overflow_policy get_overflow_policy() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return overflow;
+		}
+
+		// @returns the number of elements dropped since the queue was created.
+		size_t num_dropped() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return dropped;
+		}
+
+		queue_wait_statistics get_wait_statistics() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return wait_stats;
+		}
+
+	public:
+		/*
+		* Marks that no more elements will come. Elements already in the queue can still be extracted.
+		* Wakes up everyone waiting. Later pushes are rejected.
+		*/
+		void close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				closed = true;
+			}
+			not_empty.notify_all();
+			not_full.notify_all();
+		}
+
+		// Accepts elements again after close().
+		void reopen()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = false;
+		}
+
+		bool is_closed() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return closed;
+		}
+
+	protected:
+		/*
+		* Appends ele to the end of the queue using the move constructor.
+		* @returns true if it's queued (or spilled), in which case ele is moved from;
+		* false if it's dropped because the queue is full, or if the queue is closed, in which case ele is left untouched.
+		*/
+		bool push(T&& ele)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+
+				if (closed)
+				{
+					return false;
+				}
+
+				if (max_count == 0) // unlimited
+				{
+					if (count == ring.size())
+					{
+						resize_ring(ring.empty() ? initial_capacity : 2 * ring.size());
+					}
+				}
+				// Anything spilled means the ring is full (see set_capacity() and pop_front()).
+				else if (count == max_count)
+				{
+					switch (overflow)
+					{
+					case overflow_policy::block:
+					{
+						auto start = std::chrono::steady_clock::now();
+						not_full.wait(lock, [this]() { return count < max_count || max_count == 0 || closed; });
+						wait_stats.producer_wait += std::chrono::steady_clock::now() - start;
+					}
+						if (closed)
+						{
+							return false;
+						}
+						if (max_count == 0 && count == ring.size())
+						{
+							// the capacity was lifted while waiting.
+							resize_ring(ring.empty() ? initial_capacity : 2 * ring.size());
+						}
+						break;
+					case overflow_policy::drop:
+						++dropped;
+						return false;
+					case overflow_policy::spill:
+						spilled.emplace_back(std::move(ele));
+						return true;
+					}
+				}
+
+				ring[(head + count) % ring.size()] = std::move(ele);
+				++count;
+			}
+			not_empty.notify_one();
+
+			return true;
+		}
+
+	private:
+		// Requires: lock holds the mutex.
+		// Extracts the first element, if any, after a wait.
+		T pop_after_wait(std::unique_lock<std::mutex>& lock)
+		{
+			if (count != 0)
+			{
+				T ret{ pop_front() };
+
+				lock.unlock();
+				not_full.notify_one();
+				return ret;
+			}
+
+			return T(nullptr);
 		}
 
+		// Requires: the mutex is locked and count != 0.
+		// Takes out the first element and moves one spilled element into the ring if there is any.
+		T pop_front()
+		{
+			T ret{ std::move(ring[head]) };
+
+			head = (head + 1) % ring.size();
+			--count;
+
+			if (!spilled.empty())
+			{
+				ring[(head + count) % ring.size()] = std::move(spilled.front());
+				spilled.pop_front();
+				++count;
+			}
+
+			return ret;
+		}
+
+		// Requires: the mutex is locked and new_capacity >= count.
+		// Moves the elements to the front of a new ring of new_capacity.
+		void resize_ring(size_t new_capacity)
+		{
+			if (new_capacity == ring.size())
+			{
+				return;
+			}
+
+			std::vector<T> new_ring;
+			new_ring.reserve(new_capacity);
+			for (size_t i = 0; i != count; ++i)
+			{
+				new_ring.emplace_back(std::move(ring[(head + i) % ring.size()]));
+			}
+			// fill the rest with empty elements, which hold nothing.
+			while (new_ring.size() != new_capacity)
+			{
+				new_ring.emplace_back(nullptr);
+			}
+
+			ring.swap(new_ring);
+			head = 0;
+		}
+
+		// Requires: other's mutex is locked.
+		void copy_from(const queue_source& other)
+		{
+			ring.reserve(other.ring.size());
+			for (size_t i = 0; i != other.ring.size(); ++i)
+			{
+				// Copies of elements share their data.
+				ring.emplace_back(other.ring[(other.head + i) % other.ring.size()]);
+			}
+			count = other.count;
+			spilled = other.spilled;
+			max_count = other.max_count;
+			overflow = other.overflow;
+			dropped = other.dropped;
+			closed = other.closed;
+			wait_stats = other.wait_stats;
+		}
+
+		// Requires: other's mutex is locked.
+		void move_from(queue_source& other)
+		{
+			ring.swap(other.ring);
+			head = other.head; other.head = 0;
+			count = other.count; other.count = 0;
+			spilled.swap(other.spilled);
+			max_count = other.max_count;
+			overflow = other.overflow;
+			dropped = other.dropped;
+			closed = other.closed;
+			wait_stats = other.wait_stats;
+		}
+
+	private:
+		static constexpr size_t initial_capacity = 16;
+
+		// Slots that do not hold elements are invalid (empty) elements.
+		std::vector<T> ring;
+		// index of the first element
+		size_t head = 0;
+		// number of elements in the ring
+		size_t count = 0;
+
+		// Elements that arrived when the ring was full, under overflow_policy::spill, or that set_capacity() spilled.
+		// Only non-empty while the ring is full.
+		std::deque<T> spilled;
+
+		// capacity of the ring. 0 means unlimited.
+		size_t max_count = 0;
+		overflow_policy overflow = overflow_policy::spill;
+		size_t dropped = 0;
+
+		// true after close() until reopen()
+		bool closed = false;
+		queue_wait_statistics wait_stats;
+
 	protected:
-		std::queue<T> queue;
+		mutable std::mutex mutex;
+		// Notified when an element is taken out.
+		std::condition_variable not_full;
+		// Notified when an element is put in.
+		std::condition_variable not_empty;
 	};
 
 	using queue_packet_source = queue_source<ff::packet>;
 	using queue_frame_source = queue_source<ff::frame>;
-}
\ No newline at end of file
+}
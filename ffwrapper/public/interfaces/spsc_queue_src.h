@@ -0,0 +1,148 @@
+/*
+* spsc_queue_src.h
+*
+* Defines a lock-free queue source for exactly one producer thread and one consumer thread.
+*/
+
+#pragma once
+
+#include "src_sink.h"
+
+#include <vector>
+#include <atomic>
+#include <utility>
+#include <cstddef>
+
+namespace ff
+{
+	/*
+	* A fixed-capacity ring buffer that one thread pushes elements into and another thread takes them out of, without locks.
+	* Has the same API as queue_source for the consumer.
+	*
+	* Only try_push() may be called by the producer thread.
+	* All the other methods, except size(), empty() and capacity(), may only be called by the consumer.
+	* The consumer may move between threads as long as its calls do not overlap, e.g. when a mutex serializes them.
+	*/
+	template <typename T>
+	class spsc_queue_source : public source<T>
+	{
+	public:
+		using super = source<T>;
+		using element_t = typename super::element_t;
+
+	public:
+		spsc_queue_source() = delete;
+		// @param cap: the capacity, which will be rounded up to a power of 2.
+		explicit spsc_queue_source(size_t cap)
+		{
+			size_t rounded = 1;
+			while (rounded < cap)
+			{
+				rounded <<= 1;
+			}
+			mask = rounded - 1;
+
+			ring.reserve(rounded);
+			for (size_t i = 0; i != rounded; ++i)
+			{
+				ring.emplace_back(nullptr);
+			}
+		}
+
+		spsc_queue_source(const spsc_queue_source&) = delete;
+		spsc_queue_source& operator=(const spsc_queue_source&) = delete;
+
+		virtual ~spsc_queue_source() = default;
+
+	public:
+		/*
+		* Producer only.
+		* @returns true if ele is queued, in which case ele is moved from;
+		* false if the queue is full, in which case ele is left untouched.
+		*/
+		bool try_push(T&& ele)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == ring.size())
+			{
+				return false;
+			}
+
+			ring[t & mask] = std::move(ele);
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		/*
+		* Consumer only.
+		* Tries to extract the first available element.
+		*
+		* If !empty(), then this method always succeeds.
+		*/
+		T try_get_one() override
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire))
+			{
+				return T(nullptr);
+			}
+
+			T ret{ std::move(ring[h & mask]) };
+			head.store(h + 1, std::memory_order_release);
+			return ret;
+		}
+
+		/*
+		* Either thread.
+		* Note: even if the size is 0, it doesn't mean there will not be elements available here in the future.
+		*
+		* @returns the number of elements current available in the source.
+		*/
+		size_t size() const
+		{
+			return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);
+		}
+		// @returns true iff size() == 0.
+		bool empty() const { return size() == 0; }
+
+		size_t capacity() const { return ring.size(); }
+
+		/*
+		* Consumer only.
+		* Peeks the first element available. If empty(), then its behaviour is undefined.
+		* @returns the element peeked.
+		*/
+		const T& peek_first() const
+		{
+			return ring[head.load(std::memory_order_relaxed) & mask];
+		}
+
+		/*
+		* Consumer only.
+		* Discards all currently available elements.
+		*/
+		void clear()
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			size_t t = tail.load(std::memory_order_acquire);
+			for (; h != t; ++h)
+			{
+				ring[h & mask].destroy();
+			}
+			head.store(h, std::memory_order_release);
+		}
+
+	private:
+		// Slots that do not hold elements are invalid (empty) elements.
+		std::vector<T> ring;
+		size_t mask = 0;
+
+		// Only written by the consumer. Kept on its own cache line so that the two threads do not fight for it.
+		alignas(64) std::atomic<size_t> head{ 0 };
+		// Only written by the producer.
+		alignas(64) std::atomic<size_t> tail{ 0 };
+	};
+
+	using spsc_queue_packet_source = spsc_queue_source<ff::packet>;
+	using spsc_queue_frame_source = spsc_queue_source<ff::frame>;
+}
@@ -0,0 +1,221 @@
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "keyframe_index.h"
+#include "media.h"
+#include "frame.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+
+namespace
+{
+	constexpr char sidecar_magic[4] = { 'F', 'F', 'K', 'I' };
+	constexpr uint32_t sidecar_version = 1;
+
+	// The time a keyframe is sorted and searched by.
+	int64_t entry_time(const ff::keyframe_index::entry& e)
+	{
+		return e.pts != AV_NOPTS_VALUE ? e.pts : e.dts;
+	}
+
+	// The sidecar is little-endian whatever the machine is.
+	void write_u64(std::ostream& out, uint64_t v)
+	{
+		char bytes[8];
+		for (int i = 0; i != 8; ++i)
+		{
+			bytes[i] = (char)((v >> (8 * i)) & 0xFF);
+		}
+		out.write(bytes, 8);
+	}
+
+	bool read_u64(std::istream& in, uint64_t& v)
+	{
+		unsigned char bytes[8];
+		if (!in.read((char*)bytes, 8))
+		{
+			return false;
+		}
+		v = 0;
+		for (int i = 0; i != 8; ++i)
+		{
+			v |= (uint64_t)bytes[i] << (8 * i);
+		}
+		return true;
+	}
+
+	bool read_i64(std::istream& in, int64_t& v)
+	{
+		uint64_t u = 0;
+		if (!read_u64(in, u))
+		{
+			return false;
+		}
+		v = (int64_t)u;
+		return true;
+	}
+}
+
+ff::keyframe_index ff::keyframe_index::build(const std::string& fp)
+{
+	keyframe_index index;
+	index.filepath = fp;
+	if (!ffhelpers::get_file_version(fp, index.file_size, index.file_mtime))
+	{
+		ON_FF_ERROR("Could not get the size and the modification time of the file to index.")
+	}
+
+	ff::input_media input(fp);
+	auto fmt_ctx = input.get_format_ctx();
+
+	index.streams.resize(input.num_streams());
+	for (int i = 0; i != input.num_streams(); ++i)
+	{
+		// Only the keyframes of video streams are needed, so let the demuxer skip whatever it can.
+		fmt_ctx->streams[i]->discard = input.get_stream(i).is_video() ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+	}
+
+	ff::packet pkt;
+	int err = 0;
+	while ((err = av_read_frame(fmt_ctx, pkt)) >= 0)
+	{
+		int i = pkt->stream_index;
+		if (input.get_stream(i).is_video() && (pkt->flags & AV_PKT_FLAG_KEY) && pkt->pos >= 0)
+		{
+			index.streams[i].push_back(entry{ pkt->pts, pkt->dts, pkt->pos });
+		}
+		pkt.unref();
+	}
+	if (err != AVERROR_EOF)
+	{
+		ON_FF_ERROR_WITH_CODE("Could not read the file to index.", err)
+	}
+
+	for (auto& entries : index.streams)
+	{
+		std::stable_sort(entries.begin(), entries.end(),
+			[](const entry& a, const entry& b) { return entry_time(a) < entry_time(b); });
+	}
+
+	return index;
+}
+
+bool ff::keyframe_index::load(const std::string& fp, const std::string& sidecar)
+{
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	if (!ffhelpers::get_file_version(fp, size, mtime))
+	{
+		return false;
+	}
+
+	std::ifstream in(std::filesystem::path(sidecar.empty() ? sidecar_path(fp) : sidecar), std::ios::binary);
+	if (!in)
+	{
+		return false;
+	}
+
+	char magic[4];
+	uint64_t version = 0, stored_size = 0, num_streams = 0;
+	int64_t stored_mtime = 0;
+	if (!in.read(magic, 4) || !std::equal(magic, magic + 4, sidecar_magic)
+		|| !read_u64(in, version) || version != sidecar_version
+		|| !read_u64(in, stored_size) || !read_i64(in, stored_mtime))
+	{
+		return false;
+	}
+	// The file has changed since the index was built.
+	if (stored_size != size || stored_mtime != mtime)
+	{
+		return false;
+	}
+
+	if (!read_u64(in, num_streams) || num_streams > 65536)
+	{
+		return false;
+	}
+
+	std::vector<std::vector<entry>> loaded((size_t)num_streams);
+	for (auto& entries : loaded)
+	{
+		uint64_t num_entries = 0;
+		// Each entry takes 24 bytes, so a count larger than the file is damage.
+		if (!read_u64(in, num_entries) || num_entries > size / 24 + 1)
+		{
+			return false;
+		}
+
+		entries.resize((size_t)num_entries);
+		for (auto& e : entries)
+		{
+			if (!read_i64(in, e.pts) || !read_i64(in, e.dts) || !read_i64(in, e.pos))
+			{
+				return false;
+			}
+		}
+	}
+
+	filepath = fp;
+	file_size = size;
+	file_mtime = mtime;
+	streams.swap(loaded);
+	return true;
+}
+
+void ff::keyframe_index::save(const std::string& sidecar) const
+{
+	std::ofstream out(std::filesystem::path(sidecar.empty() ? sidecar_path(filepath) : sidecar),
+		std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		ON_FF_ERROR("Could not create the keyframe index file.")
+	}
+
+	out.write(sidecar_magic, 4);
+	write_u64(out, sidecar_version);
+	write_u64(out, file_size);
+	write_u64(out, (uint64_t)file_mtime);
+
+	write_u64(out, streams.size());
+	for (const auto& entries : streams)
+	{
+		write_u64(out, entries.size());
+		for (const auto& e : entries)
+		{
+			write_u64(out, (uint64_t)e.pts);
+			write_u64(out, (uint64_t)e.dts);
+			write_u64(out, (uint64_t)e.pos);
+		}
+	}
+
+	if (!out)
+	{
+		ON_FF_ERROR("Could not write the keyframe index file.")
+	}
+}
+
+const ff::keyframe_index::entry* ff::keyframe_index::find(int i, int64_t ts) const
+{
+	if (!has_stream(i))
+	{
+		return nullptr;
+	}
+
+	const auto& entries = streams[i];
+	// the first keyframe after ts
+	auto it = std::upper_bound(entries.begin(), entries.end(), ts,
+		[](int64_t t, const entry& e) { return t < entry_time(e); });
+
+	if (it == entries.begin())
+	{
+		return nullptr;
+	}
+	return &*(it - 1);
+}
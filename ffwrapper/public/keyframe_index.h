@@ -0,0 +1,85 @@
+/*
+* keyframe_index.h:
+* Defines an index of the keyframes of a media file, which can be kept in a sidecar file next to it.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* The pts, dts and byte position of every keyframe of every video stream of a file.
+	*
+	* Built by reading the whole file once, it lets the demuxer seek by jumping to a byte position,
+	* without relying on the index of the container, which is slow or unreliable for MPEG-TS and damaged MKV files.
+	* Only video streams are indexed: every audio packet is a keyframe, and their container indexes are good enough.
+	*
+	* The sidecar records the size and the modification time of the file, and is ignored if the file changes.
+	*/
+	class keyframe_index
+	{
+	public:
+		struct entry
+		{
+			int64_t pts = 0;
+			int64_t dts = 0;
+			// the byte position of the packet in the file
+			int64_t pos = 0;
+		};
+
+	public:
+		keyframe_index() = default;
+
+		/*
+		* Reads every packet of the file at fp and records its keyframes.
+		* @throws std::runtime_error on failure
+		*/
+		static keyframe_index build(const std::string& fp);
+
+		/*
+		* Loads the sidecar of the file at fp.
+		* @param sidecar: the path of the sidecar. Empty for the default one, see sidecar_path().
+		* @returns false if there is no sidecar, or it's damaged, or it's of another version of the file.
+		*/
+		bool load(const std::string& fp, const std::string& sidecar = std::string());
+
+		/*
+		* Writes the index to the sidecar of the file it's built from.
+		* @param sidecar: the path of the sidecar. Empty for the default one, see sidecar_path().
+		* @throws std::runtime_error if it cannot be written
+		*/
+		void save(const std::string& sidecar = std::string()) const;
+
+		// @returns the default path of the sidecar of the file at fp, which is fp followed by ".kfi".
+		static std::string sidecar_path(const std::string& fp) { return fp + ".kfi"; }
+
+	public:
+		bool empty() const { return streams.empty(); }
+
+		// @returns true iff stream i has keyframes recorded.
+		bool has_stream(int i) const { return i >= 0 && i < (int)streams.size() && !streams[i].empty(); }
+
+		const std::vector<entry>& get_entries(int i) const { return streams[i]; }
+
+		/*
+		* Finds the last keyframe of stream i at or before time ts, in the time base of the stream.
+		* Keyframes without pts are compared by their dts.
+		* @returns the keyframe, or nullptr if there's none.
+		*/
+		const entry* find(int i, int64_t ts) const;
+
+	private:
+		std::string filepath;
+
+		// The version of the file that the index is of.
+		uint64_t file_size = 0;
+		int64_t file_mtime = 0;
+
+		// each index in the vector is the index of the stream in the container. Entries are in ascending order of time.
+		std::vector<std::vector<entry>> streams;
+	};
+}
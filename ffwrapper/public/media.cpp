@@ -11,33 +11,206 @@ extern "C"
 #include "frame.h"
 #include "encoder.h"
 #include "decoder.h"
+#include "mmap_input_io.h"
+#include "async_input_io.h"
+#include "probe_cache.h"
+#include "memory_input_io.h"
+#include "tail_input_io.h"
 
 #include <filesystem>
 
-void ff::input_media::load(const std::string& fp)
+void ff::input_media::load(const std::string& fp, const input_options& opts)
 {
 	if (loaded())
 	{
 		return;
 	}
-	else
+
+	clear_streams();
+	switch (opts.backend)
+	{
+	case file_io_backend::mmap:
+		attach_io(std::make_unique<mmap_input_io>(fp));
+		open(io->url(), opts, fp);
+		break;
+	case file_io_backend::async:
+		attach_io(std::make_unique<async_input_io>(fp));
+		open(io->url(), opts, fp);
+		break;
+	case file_io_backend::memory:
+		attach_io(memory_input_io::from_file(fp));
+		open(io->url(), opts, fp);
+		break;
+	case file_io_backend::tail:
+		attach_io(std::make_unique<tail_input_io>(fp, opts.tail_settings));
+		// A growing file is another version on every load, so there is nothing to cache.
+		open(io->url(), opts, std::string());
+		break;
+	default:
+		open(std::filesystem::path(fp).string(), opts, fp);
+		break;
+	}
+
+	filepath = fp;
+
+	if (opts.load_keyframe_index)
+	{
+		// It's fine not to have one.
+		kf_index.load(fp);
+	}
+}
+
+void ff::input_media::build_keyframe_index(bool save_sidecar)
+{
+	if (filepath.empty())
+	{
+		ON_FF_ERROR("Only media loaded from files can be indexed.")
+	}
+
+	kf_index = keyframe_index::build(filepath);
+	if (save_sidecar)
+	{
+		kf_index.save();
+	}
+}
+
+void ff::input_media::load(std::unique_ptr<input_io> src, const input_options& opts)
+{
+	if (loaded())
+	{
+		return;
+	}
+
+	clear_streams();
+	attach_io(std::move(src));
+
+	filepath = io->url();
+	open(filepath, opts, std::string());
+}
+
+ff::input_media::input_media(const uint8_t* data, size_t size, const input_options& opts)
+{
+	load(std::make_unique<memory_input_io>(data, size), opts);
+}
+
+void ff::input_media::attach_io(std::unique_ptr<input_io> src)
+{
+	io = std::move(src);
+
+	p_format_ctx = avformat_alloc_context();
+	if (!p_format_ctx)
+	{
+		io.reset();
+		ON_FF_ERROR("Could not allocate format context.")
+	}
+	// The flag makes avformat_close_input() leave pb alone.
+	try
 	{
-		clear_streams();
+		p_format_ctx->pb = io->get_avio_context();
+		p_format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+	}
+	catch (const std::runtime_error&)
+	{
+		unload();
+		throw;
+	}
+}
+
+namespace
+{
+	/*
+	* @returns true iff the header has told everything a decoder needs to be opened for every stream.
+	* The pixel or sample format is not required: MP4 and MKV do not store it for H.264, HEVC or AAC,
+	 where only decoding tells it. Decoders take it from their first frame then.
+	*/
+	bool is_stream_info_complete(const AVFormatContext* ctx)
+	{
+		// More streams may be found later.
+		if (ctx->nb_streams == 0 || (ctx->ctx_flags & AVFMTCTX_NOHEADER))
+		{
+			return false;
+		}
+
+		for (unsigned int i = 0; i < ctx->nb_streams; ++i)
+		{
+			const AVCodecParameters* par = ctx->streams[i]->codecpar;
+			if (par->codec_id == AV_CODEC_ID_NONE)
+			{
+				return false;
+			}
+
+			switch (par->codec_type)
+			{
+			case AVMEDIA_TYPE_VIDEO:
+				if (par->width <= 0 || par->height <= 0)
+				{
+					return false;
+				}
+				break;
+			case AVMEDIA_TYPE_AUDIO:
+				if (par->sample_rate <= 0 || par->ch_layout.nb_channels <= 0)
+				{
+					return false;
+				}
+				break;
+			default:
+				break;
+			}
+		}
+
+		return true;
 	}
+}
 
-	int err_code = 0;
+void ff::input_media::open(const std::string& url, const input_options& opts, const std::string& file)
+{
+	AVDictionary* format_opts = nullptr;
+	if (opts.probesize > 0)
+	{
+		av_dict_set_int(&format_opts, "probesize", opts.probesize, 0);
+	}
+	if (opts.max_analyze_duration > 0)
+	{
+		av_dict_set_int(&format_opts, "analyzeduration", opts.max_analyze_duration, 0);
+	}
 
 	// get context format from the file
-	if ((err_code = avformat_open_input(&p_format_ctx, 
-		std::filesystem::path(fp).string().c_str(), nullptr, nullptr) != 0))
+	// On failure, the format context is freed by avformat_open_input().
+	int err = avformat_open_input(&p_format_ctx, url.c_str(), nullptr, &format_opts);
+	av_dict_free(&format_opts);
+	if (err != 0)
 	{
+		io.reset();
 		ON_FF_ERROR("The format context could not be obtained from the file.")
 	}
 	
-	// read stream information
-	if (avformat_find_stream_info(p_format_ctx, nullptr) < 0)
+	// read stream information, unless it's already known.
+	bool use_cache = opts.use_probe_cache && !file.empty();
+	bool probed = use_cache && probe_cache::instance().restore(file, p_format_ctx);
+	if (!probed && opts.skip_stream_info_if_complete)
 	{
-		ON_FF_ERROR("Could not find stream information.")
+		probed = is_stream_info_complete(p_format_ctx);
+	}
+
+	if (!probed)
+	{
+		if (avformat_find_stream_info(p_format_ctx, nullptr) < 0)
+		{
+			unload();
+			ON_FF_ERROR("Could not find stream information.")
+		}
+
+		if (use_cache)
+		{
+			try
+			{
+				probe_cache::instance().store(file, p_format_ctx);
+			}
+			catch (const std::runtime_error&)
+			{
+				// Not being cached only costs the next load some time.
+			}
+		}
 	}
 
 	// Find stream indices and categorize them
@@ -106,8 +279,11 @@ void ff::input_media::load(const std::string& fp)
 void ff::input_media::unload()
 {
 	clear_streams();
+	kf_index = keyframe_index();
 
+	// A custom AVIOContext is not closed with the format context, so the byte source goes after it.
 	ffhelpers::safely_close_input_format_context(&p_format_ctx);
+	io.reset();
 }
 
 void ff::input_media::clear_streams()
@@ -185,17 +361,76 @@ void ff::output_stream::set_time_base(int numerator, int denominator)
 	p_stream->time_base = AVRational{ numerator,denominator };
 }
 
-ff::output_media::output_media(const std::string& fp)
+ff::output_media::output_media(const std::string& fp, const output_options& opts)
 {
 	// See https://ffmpeg.org/doxygen/5.1/group__lavf__encoding.html#details
 
+	create_format_context(nullptr, fp.c_str());
+
+	if (opts.backend == file_output_backend::buffered)
+	{
+		try
+		{
+			io = std::make_unique<buffered_output_io>(fp, opts.buffered_settings);
+			p_format_ctx->pb = io->get_avio_context();
+		}
+		catch (const std::runtime_error&)
+		{
+			unload();
+			throw;
+		}
+		// Tells libavformat that pb is provided by the caller.
+		p_format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+	}
+	else
+	{
+		int ret = avio_open(&p_format_ctx->pb, fp.c_str(), AVIO_FLAG_READ_WRITE);
+		if (ret < 0)
+		{
+			ON_FF_ERROR("Could not open or create the output file.")
+		}
+	}
+
+	auto size = (fp.size() + 1) * sizeof(char);
+	p_format_ctx->url = (char*)av_malloc(size);
+	strcpy_s(p_format_ctx->url, size, &fp[0]);
+}
+
+ff::output_media::output_media(std::unique_ptr<output_io> sink, const std::string& format)
+{
+	// A short name first, then a file name.
+	if (av_guess_format(format.c_str(), nullptr, nullptr))
+	{
+		create_format_context(format.c_str(), nullptr);
+	}
+	else
+	{
+		create_format_context(nullptr, format.c_str());
+	}
+
+	io = std::move(sink);
+	try
+	{
+		p_format_ctx->pb = io->get_avio_context();
+	}
+	catch (const std::runtime_error&)
+	{
+		unload();
+		throw;
+	}
+	// Tells libavformat that pb is provided by the caller.
+	p_format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+}
+
+void ff::output_media::create_format_context(const char* short_name, const char* filename)
+{
 	p_format_ctx = avformat_alloc_context();
 	if (!p_format_ctx)
 	{
 		ON_FF_ERROR("Could not allocate format context.")
 	}
 
-	p_format_ctx->oformat = av_guess_format(nullptr, fp.c_str(), nullptr);
+	p_format_ctx->oformat = av_guess_format(short_name, filename, nullptr);
 	if (!(p_format_ctx->oformat))
 	{
 		ON_FF_ERROR("The output extension is not supported.")
@@ -204,24 +439,21 @@ ff::output_media::output_media(const std::string& fp)
 	// Don't need to check failures as not all formats have all these
 	for (int i = 0; i < 6; ++i)
 	{
-		codec_ids[i] = av_guess_codec(p_format_ctx->oformat, nullptr, fp.c_str(), nullptr, AVMediaType(i));
-	}
-
-	int ret = avio_open(&p_format_ctx->pb, fp.c_str(), AVIO_FLAG_READ_WRITE);
-	if (ret < 0)
-	{
-		ON_FF_ERROR("Could not open or create the output file.")
+		codec_ids[i] = av_guess_codec(p_format_ctx->oformat, nullptr, filename, nullptr, AVMediaType(i));
 	}
-
-	auto size = (fp.size() + 1) * sizeof(char);
-	p_format_ctx->url = (char*)av_malloc(size);
-	strcpy_s(p_format_ctx->url, size, &fp[0]);
 }
 
 void ff::output_media::unload()
 {
+	// A file opened by avio_open() is closed here. A custom AVIOContext belongs to the sink, which goes after the context.
+	if (p_format_ctx && !io && p_format_ctx->oformat && !(p_format_ctx->oformat->flags & AVFMT_NOFILE))
+	{
+		avio_closep(&p_format_ctx->pb);
+	}
+
 	// This already frees all the streams
 	ffhelpers::safely_free_format_context(&p_format_ctx);
+	io.reset();
 }
 
 ff::output_stream ff::output_media::add_stream(const encoder& enc)
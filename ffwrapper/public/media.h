@@ -7,8 +7,15 @@
 
 #include "ff_time.h"
 
+#include "input_io.h"
+#include "output_io.h"
+#include "buffered_output_io.h"
+#include "tail_input_io.h"
+#include "keyframe_index.h"
+
 #include <string>
 #include <vector>
+#include <memory>
 
 struct AVFormatContext;
 struct AVStream;
@@ -103,6 +110,56 @@ namespace ff
 		struct ::AVFormatContext* p_format_ctx = nullptr;
 	};
 
+	// How an input_media reads a file.
+	enum class file_io_backend
+	{
+		// The file protocol of ffmpeg, which reads through small buffers with a system call each.
+		protocol,
+		// A memory map of the whole file. See mmap_input_io.
+		mmap,
+		// Several large reads in flight ahead of the demuxer, through io_uring or a thread pool. See async_input_io.
+		async,
+		// The whole file read into memory up front, so that demuxing touches no file at all. See memory_input_io.
+		memory,
+		// Follows a file that is still being written, waiting at its end instead of ending. See tail_input_io.
+		tail
+	};
+
+	struct input_options
+	{
+		file_io_backend backend = file_io_backend::protocol;
+
+		// Loads the keyframe index sidecar of the file if there is a valid one. See keyframe_index.
+		bool load_keyframe_index = true;
+
+		// The most bytes read to detect the format and probe the streams. 0 for the default of ffmpeg.
+		int64_t probesize = 0;
+		// The most duration of the streams analyzed to probe them, in microseconds. 0 for the default of ffmpeg.
+		int64_t max_analyze_duration = 0;
+
+		/*
+		* Skips avformat_find_stream_info() if the header of the container already gives the codec, the size
+		 and the sample rate and channels of every stream, as MP4 and MKV usually do.
+		* The pixel and sample formats are then often unknown (-1) until the first frame is decoded, as the headers
+		 do not store them for e.g. H.264, HEVC and AAC. A decoder's get_output_video_info() follows its frames, so create
+		 encoders from a decoder after it has output its first frame.
+		*/
+		bool skip_stream_info_if_complete = false;
+
+		/*
+		* Restores the stream information from the probe cache of the process if the file has been probed before,
+		 and remembers it there after probing otherwise. See probe_cache.
+		* Only applies to media loaded from files, except with file_io_backend::tail.
+		*/
+		bool use_probe_cache = false;
+
+		/*
+		* Only used by file_io_backend::tail: when to stop waiting for the file to grow.
+		* To stop from another thread, cast get_io() to tail_input_io and call stop().
+		*/
+		tail_input_io::settings tail_settings;
+	};
+
 	// A container of multimedia streams for demuxing and decoding
 	class input_media : public media
 	{
@@ -113,10 +170,28 @@ namespace ff
 		/*
 		* Loads the media from a file.
 		* @param fp: filepath
+		* @param opts: how to read the file
 		* 
 		* @throws std::runtime_error if the media could be opened from that file
 		*/
-		input_media(const std::string& fp): filepath(fp) { load(fp); }
+		input_media(const std::string& fp, const input_options& opts = input_options()) { load(fp, opts); }
+
+		/*
+		* Loads the media from a custom byte source, and takes the ownership of it.
+		* To read a pipe or stdin, use a pipe_input_io, and keep opts.probesize within its rewind capacity.
+		* @param opts: how to probe it. The backend and the file-only options are ignored.
+		* 
+		* @throws std::runtime_error if the media could be opened from it
+		*/
+		explicit input_media(std::unique_ptr<input_io> io, const input_options& opts = input_options()) { load(std::move(io), opts); }
+
+		/*
+		* Loads the media from the size bytes at data, which are not copied. See memory_input_io.
+		* They must stay valid and unchanged until the media is unloaded.
+		* 
+		* @throws std::runtime_error if the media could be opened from them
+		*/
+		input_media(const uint8_t* data, size_t size, const input_options& opts = input_options());
 
 		~input_media() { unload(); }
 #pragma endregion
@@ -124,10 +199,19 @@ namespace ff
 		/*
 		* If it's not loaded, then loads it from a file.
 		* @param fp: filepath
+		* @param opts: how to read the file
 		* 
 		* @throws std::runtime_error if the media could be opened from that file
 		*/
-		void load(const std::string& fp);
+		void load(const std::string& fp, const input_options& opts = input_options());
+
+		/*
+		* If it's not loaded, then loads it from a custom byte source, and takes the ownership of it.
+		* @param opts: how to probe it. The backend and the file-only options are ignored.
+		* 
+		* @throws std::runtime_error if the media could be opened from it
+		*/
+		void load(std::unique_ptr<input_io> io, const input_options& opts = input_options());
 
 		// closes the media container and clears everything.
 		void unload();
@@ -160,9 +244,40 @@ namespace ff
 		*/
 		std::string get_extension_name() const;
 
+		// @returns the custom byte source the media is loaded from, or nullptr if it's read by the file protocol.
+		input_io* get_io() const { return io.get(); }
+
+		// @returns the keyframe index the demuxers seek with. Empty if none is loaded or built.
+		const keyframe_index& get_keyframe_index() const { return kf_index; }
+		void set_keyframe_index(keyframe_index index) { kf_index = std::move(index); }
+
+		/*
+		* Builds the keyframe index of the file by reading it through once, on a format context of its own.
+		* @param save_sidecar: whether to save it next to the file so that later loads find it.
+		* 
+		* @throws std::runtime_error on failure, or if the media is not loaded from a file
+		*/
+		void build_keyframe_index(bool save_sidecar = true);
+
+	private:
+		// Allocates the format context and makes it read from src, which it takes the ownership of.
+		void attach_io(std::unique_ptr<input_io> src);
+
+		/*
+		* Opens the format context, whose pb is already set if a custom byte source is used, and finds the streams.
+		* @param url: the url passed to avformat_open_input
+		* @param file: the path of the file the media is read from, which keys the probe cache. Empty if it's not a file.
+		*/
+		void open(const std::string& url, const input_options& opts, const std::string& file);
+
 	private:
 		std::string filepath;
 
+		// The custom byte source, if any. It must outlive the format context.
+		std::unique_ptr<input_io> io;
+
+		keyframe_index kf_index;
+
 #pragma region streams
 		// each index in the vector is the index of the stream in the container.
 		std::vector<input_stream> streams;
@@ -176,6 +291,23 @@ namespace ff
 		double duration;
 	};
 
+	// How an output_media writes a file.
+	enum class file_output_backend
+	{
+		// avio_open, which writes each small buffer of the AVIOContext with a system call.
+		protocol,
+		// Large aligned blocks, preallocation and a flush thread. See buffered_output_io.
+		buffered
+	};
+
+	struct output_options
+	{
+		file_output_backend backend = file_output_backend::protocol;
+
+		// Only used by file_output_backend::buffered
+		buffered_output_io::settings buffered_settings;
+	};
+
 	class output_media : public media
 	{
 	public:
@@ -188,10 +320,22 @@ namespace ff
 		* It does not create any streams or do any further work.
 		* 
 		* @param fp: filepath
+		* @param opts: how to write the file
+		*
+		* @throws std::runtime_error on failure
+		*/
+		output_media(const std::string& fp, const output_options& opts = output_options());
+
+		/*
+		* Links the output media with a custom byte sink, and takes the ownership of it.
+		* Otherwise the same as output_media(fp).
+		* 
+		* @param io: the sink, e.g. a memory_output_io to mux in memory
+		* @param format: the short name of the format (e.g. "mp4", "matroska"), or a file name to guess it from (e.g. "a.mkv")
 		*
 		* @throws std::runtime_error on failure
 		*/
-		output_media(const std::string& fp);
+		output_media(std::unique_ptr<output_io> io, const std::string& format);
 
 		~output_media() { unload(); }
 #pragma endregion
@@ -199,6 +343,9 @@ namespace ff
 		// closes the media container and destroys all streams.
 		void unload();
 
+		// @returns the custom byte sink the media is written to, or nullptr if it's written to a file.
+		output_io* get_io() const { return io.get(); }
+
 	public:
 		// @returns the codec id corresponding to the media type, which can be used to initialize an encoder.
 		int get_codec_id(int i) const { return codec_ids[i]; }
@@ -235,6 +382,16 @@ namespace ff
 		int num_subtitles() const override { return (int)sinds.size(); }
 
 	private:
+		/*
+		* Allocates the format context with the format of short_name or of filename, and guesses the codec IDs.
+		* @throws std::runtime_error on failure
+		*/
+		void create_format_context(const char* short_name, const char* filename);
+
+	private:
+		// The custom byte sink, if any. It must outlive the format context.
+		std::unique_ptr<output_io> io;
+
 		// v,a,data,s,attachment,nb
 		int codec_ids[6] = { -1,-1,-1,-1,-1,-1 };
 
@@ -0,0 +1,95 @@
+extern "C"
+{
+#include <libavutil/error.h>
+}
+
+#include "memory_input_io.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+ff::memory_input_io::memory_input_io(const uint8_t* bytes, size_t size) :
+	data(bytes), length(size)
+{
+}
+
+ff::memory_input_io::memory_input_io(std::vector<uint8_t>&& bytes) :
+	owned(std::move(bytes))
+{
+	data = owned.data();
+	length = owned.size();
+}
+
+std::unique_ptr<ff::memory_input_io> ff::memory_input_io::from_file(const std::string& fp)
+{
+	std::ifstream in(std::filesystem::path(fp), std::ios::binary | std::ios::ate);
+	if (!in)
+	{
+		ON_FF_ERROR("Could not open the file to read into memory.")
+	}
+
+	auto end = in.tellg();
+	if (end < 0)
+	{
+		ON_FF_ERROR("Could not get the size of the file to read into memory.")
+	}
+
+	std::vector<uint8_t> bytes((size_t)end);
+	in.seekg(0);
+	if (!bytes.empty() && !in.read((char*)bytes.data(), (std::streamsize)bytes.size()))
+	{
+		ON_FF_ERROR("Could not read the file into memory.")
+	}
+
+	auto io = std::make_unique<memory_input_io>(std::move(bytes));
+	io->filepath = fp;
+	return io;
+}
+
+int ff::memory_input_io::read(uint8_t* buf, int size)
+{
+	if (pos >= length)
+	{
+		return AVERROR_EOF;
+	}
+
+	size_t n = std::min((size_t)size, length - pos);
+	std::memcpy(buf, data + pos, n);
+	pos += n;
+
+	return (int)n;
+}
+
+int64_t ff::memory_input_io::seek(int64_t offset, int whence)
+{
+	int64_t base = 0;
+	switch (whence)
+	{
+	case SEEK_SET:
+		base = 0;
+		break;
+	case SEEK_CUR:
+		base = (int64_t)pos;
+		break;
+	case SEEK_END:
+		base = (int64_t)length;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	int64_t new_pos = base + offset;
+	if (new_pos < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	// Past the end is allowed. Reading from there gives EOF.
+	pos = (size_t)new_pos;
+	return new_pos;
+}
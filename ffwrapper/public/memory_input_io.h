@@ -0,0 +1,57 @@
+/*
+* memory_input_io.h:
+* Defines an input_io that reads bytes already in memory.
+*/
+
+#pragma once
+
+#include "input_io.h"
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+namespace ff
+{
+	/*
+	* Serves ffmpeg from a span of bytes in memory, e.g. a container produced by another stage, or a whole file read up front.
+	* Reading is a copy out of the span, and seeking is just moving a position.
+	*
+	* The span is either borrowed, in which case it must outlive the io, or owned.
+	*/
+	class memory_input_io : public input_io
+	{
+	public:
+		memory_input_io() = delete;
+		/*
+		* Reads from the size bytes at data, which are not copied.
+		* They must stay valid and unchanged until the io is destroyed.
+		*/
+		memory_input_io(const uint8_t* data, size_t size);
+		// Reads from bytes, which the io takes the ownership of.
+		explicit memory_input_io(std::vector<uint8_t>&& bytes);
+
+		/*
+		* Reads the whole file at fp into memory.
+		* @throws std::runtime_error if the file cannot be read
+		*/
+		static std::unique_ptr<memory_input_io> from_file(const std::string& fp);
+
+	public:
+		int read(uint8_t* buf, int size) override;
+		int64_t seek(int64_t offset, int whence) override;
+		int64_t size() const override { return (int64_t)length; }
+
+		std::string url() const override { return filepath; }
+
+	private:
+		// empty unless the bytes are owned
+		std::vector<uint8_t> owned;
+		// the file the bytes are read from, if any
+		std::string filepath;
+
+		const uint8_t* data = nullptr;
+		size_t length = 0;
+		size_t pos = 0;
+	};
+}
@@ -0,0 +1,75 @@
+extern "C"
+{
+#include <libavutil/error.h>
+}
+
+#include "memory_output_io.h"
+
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+ff::memory_output_io::memory_output_io(size_t initial_capacity)
+{
+	bytes.reserve(initial_capacity);
+}
+
+int ff::memory_output_io::write(const uint8_t* buf, int size)
+{
+	if (size <= 0)
+	{
+		return 0;
+	}
+
+	size_t end = pos + (size_t)size;
+	if (end > bytes.size())
+	{
+		// Grow geometrically so that appending stays amortized O(1).
+		if (end > bytes.capacity())
+		{
+			bytes.reserve(std::max(end, bytes.capacity() * 2));
+		}
+		bytes.resize(end);
+	}
+
+	std::memcpy(bytes.data() + pos, buf, (size_t)size);
+	pos = end;
+
+	return size;
+}
+
+int64_t ff::memory_output_io::seek(int64_t offset, int whence)
+{
+	int64_t base = 0;
+	switch (whence)
+	{
+	case SEEK_SET:
+		base = 0;
+		break;
+	case SEEK_CUR:
+		base = (int64_t)pos;
+		break;
+	case SEEK_END:
+		base = (int64_t)bytes.size();
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	int64_t new_pos = base + offset;
+	if (new_pos < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	pos = (size_t)new_pos;
+	return new_pos;
+}
+
+std::vector<uint8_t> ff::memory_output_io::take()
+{
+	std::vector<uint8_t> ret;
+	ret.swap(bytes);
+	pos = 0;
+	return ret;
+}
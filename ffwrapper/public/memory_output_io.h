@@ -0,0 +1,46 @@
+/*
+* memory_output_io.h:
+* Defines an output_io that collects the bytes in a growable buffer in memory.
+*/
+
+#pragma once
+
+#include "output_io.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* Collects the muxed bytes in memory, so that a container can be made without touching the disk
+	 and handed to the next stage (e.g. through memory_input_io).
+	*
+	* The buffer grows as needed, doubling its capacity. Seeking back and overwriting is supported,
+	 as some muxers (e.g. MP4) go back to fill in sizes. Seeking past the end and writing there fills the gap with zeros.
+	*
+	* The bytes are complete after the muxer is finalized (see muxer::finalize()). Call flush() to look at them before that.
+	*/
+	class memory_output_io : public output_io
+	{
+	public:
+		// @param initial_capacity: the number of bytes to reserve up front, which avoids growing the buffer if it's large enough.
+		explicit memory_output_io(size_t initial_capacity = 0);
+
+	public:
+		int write(const uint8_t* buf, int size) override;
+		int64_t seek(int64_t offset, int whence) override;
+		int64_t size() const override { return (int64_t)bytes.size(); }
+
+	public:
+		const uint8_t* data() const { return bytes.data(); }
+		const std::vector<uint8_t>& get_bytes() const { return bytes; }
+
+		// Moves the bytes out. The io becomes empty, and the position goes back to 0.
+		std::vector<uint8_t> take();
+
+	private:
+		std::vector<uint8_t> bytes;
+		size_t pos = 0;
+	};
+}
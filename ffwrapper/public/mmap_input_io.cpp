@@ -0,0 +1,232 @@
+extern "C"
+{
+#include <libavutil/error.h>
+}
+
+#include "mmap_input_io.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	size_t page_size()
+	{
+#if defined(_WIN32)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+}
+
+ff::mmap_input_io::mmap_input_io(const std::string& fp) :
+	mmap_input_io(fp, settings())
+{
+}
+
+ff::mmap_input_io::mmap_input_io(const std::string& fp, const settings& s) :
+	filepath(fp), opts(s)
+{
+	if (opts.buffer_size <= 0)
+	{
+		opts.buffer_size = default_buffer_size;
+	}
+
+#if defined(_WIN32)
+	file_handle = CreateFileW(std::filesystem::path(fp).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		ON_FF_ERROR("Could not open the file to map.")
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size))
+	{
+		unmap();
+		ON_FF_ERROR("Could not get the size of the file to map.")
+	}
+	length = (size_t)file_size.QuadPart;
+
+	// An empty file cannot be mapped, and there is nothing to read anyway.
+	if (length != 0)
+	{
+		mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping_handle)
+		{
+			unmap();
+			ON_FF_ERROR("Could not create the mapping of the file.")
+		}
+
+		data = (const uint8_t*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+		if (!data)
+		{
+			unmap();
+			ON_FF_ERROR("Could not map the file.")
+		}
+	}
+#else
+	fd = open(std::filesystem::path(fp).string().c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		ON_FF_ERROR("Could not open the file to map.")
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		unmap();
+		ON_FF_ERROR("Could not get the size of the file to map.")
+	}
+	length = (size_t)st.st_size;
+
+	// An empty file cannot be mapped, and there is nothing to read anyway.
+	if (length != 0)
+	{
+		void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			unmap();
+			ON_FF_ERROR("Could not map the file.")
+		}
+		data = (const uint8_t*)p;
+
+		madvise(p, length, MADV_SEQUENTIAL);
+	}
+#endif
+
+	advise_will_need();
+}
+
+ff::mmap_input_io::~mmap_input_io()
+{
+	unmap();
+}
+
+int ff::mmap_input_io::read(uint8_t* buf, int size)
+{
+	if (pos >= length)
+	{
+		return AVERROR_EOF;
+	}
+
+	advise_will_need();
+
+	size_t n = std::min((size_t)size, length - pos);
+	std::memcpy(buf, data + pos, n);
+	pos += n;
+
+	return (int)n;
+}
+
+int64_t ff::mmap_input_io::seek(int64_t offset, int whence)
+{
+	int64_t base = 0;
+	switch (whence)
+	{
+	case SEEK_SET:
+		base = 0;
+		break;
+	case SEEK_CUR:
+		base = (int64_t)pos;
+		break;
+	case SEEK_END:
+		base = (int64_t)length;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	int64_t new_pos = base + offset;
+	if (new_pos < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	// Past the end is allowed. Reading from there gives EOF.
+	pos = (size_t)new_pos;
+	return new_pos;
+}
+
+void ff::mmap_input_io::advise_will_need()
+{
+	if (!data || opts.read_ahead_window == 0)
+	{
+		return;
+	}
+
+	// Ask for the next window when half of the current one is consumed, or when pos jumped out of it.
+	// The last window reaches the end, so there is nothing more to ask for.
+	if (pos >= advised_begin && (advised_end == length || pos + opts.read_ahead_window / 2 < advised_end))
+	{
+		return;
+	}
+
+	static const size_t page = page_size();
+	size_t begin = pos / page * page;
+	size_t end = std::min(length, pos + opts.read_ahead_window);
+	if (begin >= end)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (PVOID)(data + begin);
+	range.NumberOfBytes = end - begin;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	madvise((void*)(data + begin), end - begin, MADV_WILLNEED);
+#endif
+
+	advised_begin = begin;
+	advised_end = end;
+}
+
+void ff::mmap_input_io::unmap()
+{
+#if defined(_WIN32)
+	if (data)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mapping_handle)
+	{
+		CloseHandle(mapping_handle);
+	}
+	if (file_handle)
+	{
+		CloseHandle(file_handle);
+	}
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+#else
+	if (data)
+	{
+		munmap((void*)data, length);
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	fd = -1;
+#endif
+	data = nullptr;
+}
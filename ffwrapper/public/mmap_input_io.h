@@ -0,0 +1,79 @@
+/*
+* mmap_input_io.h:
+* Defines an input_io that reads a local file through a read-only memory map.
+*/
+
+#pragma once
+
+#include "input_io.h"
+
+#include <cstddef>
+
+namespace ff
+{
+	/*
+	* Maps the whole file into memory and serves ffmpeg from the mapping,
+	* so that reading takes no system calls and seeking is just moving a position.
+	*
+	* The kernel is told that the file is read sequentially, and the pages ahead of the position are asked for
+	* in windows of settings::read_ahead_window bytes, also after a seek.
+	*
+	* Needs the address space for the whole file, so it's meant for 64-bit builds.
+	*/
+	class mmap_input_io : public input_io
+	{
+	public:
+		struct settings
+		{
+			// number of bytes ahead of the position that the kernel is asked to have in memory
+			size_t read_ahead_window = 16 * 1024 * 1024;
+			// number of bytes ffmpeg takes at a time. Larger buffers mean fewer calls to read().
+			int buffer_size = 256 * 1024;
+		};
+
+	public:
+		mmap_input_io() = delete;
+		/*
+		* Maps the file at fp.
+		* @throws std::runtime_error if the file cannot be opened or mapped
+		*/
+		mmap_input_io(const std::string& fp, const settings& s);
+		// Uses the default settings.
+		explicit mmap_input_io(const std::string& fp);
+
+		// Unmaps the file.
+		~mmap_input_io() override;
+
+	public:
+		int read(uint8_t* buf, int size) override;
+		int64_t seek(int64_t offset, int whence) override;
+		int64_t size() const override { return (int64_t)length; }
+
+		int buffer_size() const override { return opts.buffer_size; }
+		std::string url() const override { return filepath; }
+
+	private:
+		// Asks the kernel to bring in the window after pos if pos is out of the window asked for last time.
+		void advise_will_need();
+
+		void unmap();
+
+	private:
+		std::string filepath;
+		settings opts;
+
+		const uint8_t* data = nullptr;
+		size_t length = 0;
+		size_t pos = 0;
+
+		// the range last asked for by advise_will_need()
+		size_t advised_begin = 0, advised_end = 0;
+
+#if defined(_WIN32)
+		void* file_handle = nullptr;
+		void* mapping_handle = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+}
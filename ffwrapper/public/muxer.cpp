@@ -6,6 +6,8 @@ extern "C"
 #include "muxer.h"
 #include "frame.h"
 #include "media.h"
+#include "packet_pool.h"
+#include "output_io.h"
 #include "../private/ff_helpers.h"
 
 #include <stdexcept>
@@ -22,15 +24,27 @@ void ff::muxer::write_file_header()
 
 bool ff::muxer::try_feed(ff::packet& pkt)
 {
-	int ret = 0;
-	if ((ret = av_interleaved_write_frame(fmt_ctx, pkt)) < 0)
+	status st = feed(pkt);
+	if (!st.ok())
 	{
-		ON_FF_ERROR_WITH_CODE("Could not feed a packet to the output file: ", ret)
+		ON_FF_ERROR_WITH_CODE("Could not feed a packet to the output file: ", st.code)
 	}
 
 	return true;
 }
 
+ff::status ff::muxer::feed(ff::packet& pkt) noexcept
+{
+	status st(av_interleaved_write_frame(fmt_ctx, pkt));
+
+	if (st.ok() && pkt_pool)
+	{
+		pkt_pool->release(pkt);
+	}
+
+	return st;
+}
+
 void ff::muxer::finalize()
 {
 	int ret;
@@ -38,4 +52,9 @@ void ff::muxer::finalize()
 	{
 		ON_FF_ERROR_WITH_CODE("Could not finalize the output file.", ret)
 	}
+
+	if (io && (ret = io->finish()) < 0)
+	{
+		ON_FF_ERROR_WITH_CODE("Could not write out the rest of the output file.", ret)
+	}
 }
@@ -2,6 +2,7 @@
 
 #include "interfaces/src_sink.h"
 #include "media.h"
+#include "status.h"
 
 struct AVFormatContext;
 
@@ -26,7 +27,7 @@ namespace ff
 	{
 	public:
 		explicit muxer(::AVFormatContext* fmt) : fmt_ctx(fmt) {}
-		muxer(const output_media& m) : muxer(m.get_format_ctx()) {}
+		muxer(const output_media& m) : fmt_ctx(m.get_format_ctx()), io(m.get_io()) {}
 		virtual ~muxer() = default;
 
 	public:
@@ -45,20 +46,43 @@ namespace ff
 		* Feeds a packet to the output file.
 		* The pkt's content will be copied by the function and will be cleared.
 		* Then, the packet can be reused as if it's come clean from allocation.
+		* If a packet pool is set, then the packet is given back to the pool instead and becomes invalid.
+		 Unrefing it then does nothing, but it must be allocate()d again before it's reused.
 		* 
 		* @returns always true.
 		* @throws std::runtime_error on failure.
 		*/
 		bool try_feed(ff::packet& pkt) override;
 
+		/*
+		* The non-throwing version of try_feed().
+		* @returns ok() if the packet is written; is_error() on failure.
+		*/
+		status feed(ff::packet& pkt) noexcept;
+
 		/*
 		* Finalizes the output media. After calling this, the output file will be ready and
 		* the user should not do anything to it except reading the exisiting info.
+		* If the media is written to a custom byte sink, the sink is finished as well (see output_io::finish()).
+		* 
+		* @throws std::runtime_error on failure.
 		*/
 		void finalize();
 
+		/*
+		* Makes the muxer give the packets fed to it back to pool so that their producers can reuse them.
+		* The pool is not owned by the muxer and must outlive it, or be unset by passing nullptr.
+		*/
+		void set_packet_pool(class packet_pool* pool) { pkt_pool = pool; }
+
 	protected:
 		// Does not own this. Just for referencing.
 		::AVFormatContext* fmt_ctx;
+
+		// The custom byte sink of the output media, if any. Does not own this.
+		class output_io* io = nullptr;
+
+		// Does not own this.
+		class packet_pool* pkt_pool = nullptr;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include "output_io.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+
+namespace
+{
+	// Callbacks of the AVIOContext. opaque is the output_io.
+	// The buffer became const in libavformat 61.
+#if defined(FF_API_AVIO_WRITE_NONCONST) && !FF_API_AVIO_WRITE_NONCONST
+	int write_callback(void* opaque, const uint8_t* buf, int size)
+#else
+	int write_callback(void* opaque, uint8_t* buf, int size)
+#endif
+	{
+		return static_cast<ff::output_io*>(opaque)->write(buf, size);
+	}
+
+	int64_t seek_callback(void* opaque, int64_t offset, int whence)
+	{
+		auto io = static_cast<ff::output_io*>(opaque);
+
+		// ffmpeg asks for the size this way.
+		if (whence & AVSEEK_SIZE)
+		{
+			return io->size();
+		}
+
+		// AVSEEK_FORCE only asks to seek even if it's expensive.
+		return io->seek(offset, whence & ~AVSEEK_FORCE);
+	}
+}
+
+ff::output_io::~output_io()
+{
+	ffhelpers::safely_free_custom_avio_context(&avio_ctx);
+}
+
+::AVIOContext* ff::output_io::get_avio_context()
+{
+	if (avio_ctx)
+	{
+		return avio_ctx;
+	}
+
+	int buf_size = buffer_size();
+	auto buf = (unsigned char*)av_malloc(buf_size);
+	if (!buf)
+	{
+		ON_FF_ERROR("Could not allocate the buffer of the I/O context.")
+	}
+
+	avio_ctx = avio_alloc_context(buf, buf_size, 1, this, nullptr, &write_callback, seekable() ? &seek_callback : nullptr);
+	if (!avio_ctx)
+	{
+		av_free(buf);
+		ON_FF_ERROR("Could not allocate the I/O context.")
+	}
+	avio_ctx->seekable = seekable() ? AVIO_SEEKABLE_NORMAL : 0;
+
+	return avio_ctx;
+}
+
+void ff::output_io::flush()
+{
+	if (avio_ctx)
+	{
+		avio_flush(avio_ctx);
+	}
+}
@@ -0,0 +1,85 @@
+/*
+* output_io.h:
+* Defines the base class of custom byte sinks that an output_media can be muxed into,
+* instead of a file opened by avio_open.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct AVIOContext;
+
+namespace ff
+{
+	/*
+	* A sink of bytes behind an output_media.
+	*
+	* Subclasses implement write() and seek(). ffmpeg writes through the AVIOContext made by get_avio_context(),
+	* which calls them.
+	* Once an output_media is created on an output_io, it owns it.
+	*/
+	class output_io
+	{
+	public:
+		output_io() = default;
+
+		output_io(const output_io&) = delete;
+		output_io& operator=(const output_io&) = delete;
+
+		// Frees the AVIOContext.
+		virtual ~output_io();
+
+	public:
+		/*
+		* Writes the size bytes at buf at the position.
+		* @returns the number of bytes written, or a negative AVERROR code on failure.
+		*/
+		virtual int write(const uint8_t* buf, int size) = 0;
+
+		/*
+		* Moves the position to offset, relative to whence (SEEK_SET, SEEK_CUR or SEEK_END).
+		* @returns the new position, or a negative AVERROR code if it cannot move there.
+		*/
+		virtual int64_t seek(int64_t offset, int whence) = 0;
+
+		// @returns the number of bytes written so far, or a negative AVERROR code if it's unknown.
+		virtual int64_t size() const = 0;
+
+		// @returns false if seek() does not work, so that muxers that can avoid seeking do.
+		virtual bool seekable() const { return true; }
+
+		// @returns the number of bytes ffmpeg gathers before calling write().
+		virtual int buffer_size() const { return default_buffer_size; }
+
+		// @returns the location of the bytes, used as the url of the format context. May be empty.
+		virtual std::string url() const { return std::string(); }
+
+		/*
+		* Called by the muxer after the trailer is written, so that a sink that holds bytes back can write them out.
+		* @returns 0, or a negative AVERROR code if the bytes could not all be written.
+		*/
+		virtual int finish() { return 0; }
+
+	public:
+		/*
+		* Creates the AVIOContext on the first call. It's owned by this.
+		* @throws std::runtime_error on failure
+		*/
+		::AVIOContext* get_avio_context();
+
+		/*
+		* Writes out whatever ffmpeg still holds in the buffer of the AVIOContext.
+		* av_write_trailer() does it as well, so this is only needed to look at the bytes before the media is finalized.
+		*/
+		void flush();
+
+	protected:
+		// the buffer size of the file protocol of ffmpeg
+		static constexpr int default_buffer_size = 32 * 1024;
+
+	private:
+		::AVIOContext* avio_ctx = nullptr;
+	};
+}
@@ -0,0 +1,104 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include "packet_pool.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <new>
+
+ff::packet_pool::packet_pool(size_t num_preallocated)
+{
+	free_shells.reserve(num_preallocated);
+	for (size_t i = 0; i != num_preallocated; ++i)
+	{
+		::AVPacket* shell = av_packet_alloc();
+		if (!shell)
+		{
+			ON_FF_ERROR("Could not alloc packet.")
+		}
+		free_shells.push_back(shell);
+		++stats.num_packet_allocations;
+	}
+}
+
+ff::packet_pool::~packet_pool()
+{
+	for (auto* shell : free_shells)
+	{
+		ffhelpers::safely_free_packet(&shell);
+	}
+}
+
+ff::packet ff::packet_pool::acquire()
+{
+	ff::packet pkt(nullptr);
+	if (!try_acquire(pkt))
+	{
+		ON_FF_ERROR("Could not alloc packet.")
+	}
+
+	return pkt;
+}
+
+bool ff::packet_pool::try_acquire(ff::packet& pkt) noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++stats.num_acquisitions;
+
+		if (!free_shells.empty())
+		{
+			pkt = ff::packet(free_shells.back());
+			free_shells.pop_back();
+			return true;
+		}
+	}
+
+	// allocates a new one
+	pkt = ff::packet(av_packet_alloc());
+	if (!pkt.is_valid())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	++stats.num_packet_allocations;
+	return true;
+}
+
+void ff::packet_pool::release(ff::packet& pkt) noexcept
+{
+	if (!pkt.is_valid())
+	{
+		return;
+	}
+
+	pkt.unref();
+
+	try
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		free_shells.push_back(pkt.buffer);
+		pkt.relinquish_ownership();
+	}
+	catch (const std::bad_alloc&)
+	{
+		// no room to keep it. Just let it go.
+		pkt.destroy();
+	}
+}
+
+size_t ff::packet_pool::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return free_shells.size();
+}
+
+ff::packet_pool::statistics ff::packet_pool::get_statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
@@ -0,0 +1,88 @@
+/*
+* packet_pool.h:
+* Defines a pool that recycles packets between their producers (demuxers, encoders) and their consumers (muxers, decoders).
+*/
+
+#pragma once
+
+#include "frame.h"
+
+#include <vector>
+#include <cstdint>
+#include <mutex>
+
+struct AVPacket;
+
+namespace ff
+{
+	/*
+	* Keeps AVPacket shells that have been consumed so that producers can reuse them instead of calling av_packet_alloc.
+	*
+	* Recycling work flow:
+	* 1. Give the pool to the producers (demuxer::set_packet_pool(), encoder::set_packet_pool()).
+	 They will acquire() the packets they output from it.
+	* 2. Give the pool to the consumers (muxer::set_packet_pool(), decoder::set_packet_pool()).
+	 After a packet is fed successfully, they will release() it back to the pool.
+	*
+	* After a warm-up, the number of shells in circulation stays constant and no more are allocated.
+	* Note that the payload of a packet is still allocated by whoever fills it (e.g. the demuxer of the container format).
+	*
+	* Thread-safe, so that a producer on one thread (e.g. a demuxer reading ahead) can share it with consumers on another.
+	*/
+	class packet_pool
+	{
+	public:
+		struct statistics
+		{
+			// number of AVPacket shells allocated
+			uint64_t num_packet_allocations = 0;
+			// number of calls to acquire()
+			uint64_t num_acquisitions = 0;
+		};
+
+	public:
+		packet_pool() = default;
+		/*
+		* Creates a pool with num_preallocated shells ready.
+		* @throws std::runtime_error on failure
+		*/
+		explicit packet_pool(size_t num_preallocated);
+
+		packet_pool(const packet_pool&) = delete;
+		packet_pool& operator=(const packet_pool&) = delete;
+
+		// Frees all shells in the pool. Packets acquired but not released are not affected.
+		~packet_pool();
+
+	public:
+		/*
+		* @returns a clean packet.
+		* @throws std::runtime_error on failure
+		*/
+		ff::packet acquire();
+
+		/*
+		* The non-throwing version of acquire(). pkt must be invalid, or its shell will be destroyed.
+		* @returns false if a new shell is needed but could not be allocated.
+		*/
+		bool try_acquire(ff::packet& pkt) noexcept;
+
+		/*
+		* Unrefs the packet and keeps its shell in the pool.
+		* After this, pkt is invalid. Invalid packets are ignored.
+		*/
+		void release(ff::packet& pkt) noexcept;
+		void release(ff::packet&& pkt) noexcept { release(pkt); }
+
+		// @returns the number of shells currently in the pool.
+		size_t size() const;
+
+		statistics get_statistics() const;
+
+	private:
+		mutable std::mutex mutex;
+		std::vector<::AVPacket*> free_shells;
+
+		statistics stats;
+	};
+}
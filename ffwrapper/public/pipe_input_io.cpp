@@ -0,0 +1,164 @@
+extern "C"
+{
+#include <libavutil/error.h>
+}
+
+#include "pipe_input_io.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+ff::pipe_input_io::pipe_input_io(int file_descriptor) :
+	pipe_input_io(file_descriptor, settings())
+{
+}
+
+ff::pipe_input_io::pipe_input_io(int file_descriptor, const settings& s) :
+	fd(file_descriptor), opts(s)
+{
+	if (opts.read_size <= 0)
+	{
+		opts.read_size = default_buffer_size;
+	}
+	// There must be room for at least one read.
+	ring.resize(std::max(opts.rewind_capacity, (size_t)opts.read_size));
+
+#if defined(_WIN32)
+	// Descriptors, stdin above all, are opened in text mode, which turns CR LF into LF and stops at Ctrl+Z.
+	if (fd >= 0)
+	{
+		_setmode(fd, _O_BINARY);
+	}
+#endif
+}
+
+ff::pipe_input_io::~pipe_input_io()
+{
+	if (opts.close_on_destruction && fd >= 0)
+	{
+#if defined(_WIN32)
+		_close(fd);
+#else
+		close(fd);
+#endif
+	}
+}
+
+int64_t ff::pipe_input_io::size() const
+{
+	return AVERROR(ENOSYS);
+}
+
+int64_t ff::pipe_input_io::window_start() const
+{
+	return std::max<int64_t>(0, window_end - (int64_t)ring.size());
+}
+
+int ff::pipe_input_io::fill()
+{
+	if (eof)
+	{
+		return AVERROR_EOF;
+	}
+
+	// Read into the contiguous part of the ring after the end.
+	size_t at = (size_t)(window_end % (int64_t)ring.size());
+	size_t len = std::min((size_t)opts.read_size, ring.size() - at);
+
+	while (true)
+	{
+#if defined(_WIN32)
+		int n = _read(fd, ring.data() + at, (unsigned int)len);
+#else
+		ssize_t n = ::read(fd, ring.data() + at, len);
+#endif
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return AVERROR(errno);
+		}
+		if (n == 0)
+		{
+			eof = true;
+			return AVERROR_EOF;
+		}
+
+		window_end += n;
+		stats.num_bytes_read += n;
+		return (int)n;
+	}
+}
+
+int ff::pipe_input_io::read(uint8_t* buf, int size)
+{
+	if (pos == window_end)
+	{
+		int ret = fill();
+		if (ret < 0)
+		{
+			return ret;
+		}
+	}
+
+	// Copy up to the end of what's read, in at most two pieces as the ring may wrap around.
+	size_t n = (size_t)std::min<int64_t>(size, window_end - pos);
+	size_t at = (size_t)(pos % (int64_t)ring.size());
+	size_t first = std::min(n, ring.size() - at);
+	std::memcpy(buf, ring.data() + at, first);
+	std::memcpy(buf + first, ring.data(), n - first);
+	pos += n;
+
+	return (int)n;
+}
+
+int64_t ff::pipe_input_io::seek(int64_t offset, int whence)
+{
+	int64_t new_pos = 0;
+	switch (whence)
+	{
+	case SEEK_SET:
+		new_pos = offset;
+		break;
+	case SEEK_CUR:
+		new_pos = pos + offset;
+		break;
+	default:
+		// The end is unknown.
+		return AVERROR(ESPIPE);
+	}
+
+	if (new_pos < window_start())
+	{
+		// The bytes are gone.
+		return AVERROR(ESPIPE);
+	}
+
+	// Drop the bytes in between.
+	while (new_pos > window_end)
+	{
+		int ret = fill();
+		if (ret < 0)
+		{
+			return ret;
+		}
+	}
+
+	if (new_pos < pos)
+	{
+		stats.max_rewind = std::max(stats.max_rewind, (uint64_t)(window_end - new_pos));
+	}
+	pos = new_pos;
+	return pos;
+}
@@ -0,0 +1,91 @@
+/*
+* pipe_input_io.h:
+* Defines an input_io that reads a stream of bytes from a file descriptor, such as a pipe or stdin.
+*/
+
+#pragma once
+
+#include "input_io.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* Reads from a file descriptor that cannot seek, e.g. the output of a capture tool piped into the process.
+	*
+	* The last settings::rewind_capacity bytes read are kept in a ring buffer, so that the seeks back done while
+	 probing the format work as long as they stay within them. Seeking forward reads and drops the bytes in between.
+	* Anything else fails, so containers that must seek far (e.g. MP4 with the moov atom at the end) cannot be read this way.
+	* Use MPEG-TS, MKV or fragmented MP4 through pipes.
+	*
+	* To read stdin, pass 0 as the file descriptor. On Windows, the file descriptor is switched to binary mode.
+	*/
+	class pipe_input_io : public input_io
+	{
+	public:
+		struct settings
+		{
+			// The number of bytes kept behind the position for seeking back.
+			size_t rewind_capacity = 8 * 1024 * 1024;
+			// The most bytes asked from the file descriptor at a time.
+			int read_size = 256 * 1024;
+			// Closes the file descriptor on destruction.
+			bool close_on_destruction = false;
+		};
+
+		struct statistics
+		{
+			uint64_t num_bytes_read = 0;
+			// the farthest seek back, in bytes. Compare it with the rewind capacity.
+			uint64_t max_rewind = 0;
+		};
+
+	public:
+		pipe_input_io() = delete;
+		pipe_input_io(int fd, const settings& s);
+		// Uses the default settings.
+		explicit pipe_input_io(int fd);
+
+		// Closes the file descriptor if settings::close_on_destruction.
+		~pipe_input_io() override;
+
+	public:
+		int read(uint8_t* buf, int size) override;
+		int64_t seek(int64_t offset, int whence) override;
+		// The size of a stream is unknown.
+		int64_t size() const override;
+
+		bool seekable() const override { return false; }
+		int buffer_size() const override { return opts.read_size; }
+		std::string url() const override { return "pipe:" + std::to_string(fd); }
+
+	public:
+		const statistics& get_statistics() const { return stats; }
+
+	private:
+		/*
+		* Reads the next bytes from the file descriptor into the ring, overwriting the oldest ones.
+		* @returns the number of bytes read, AVERROR_EOF at the end, or another negative AVERROR code on failure.
+		*/
+		int fill();
+
+		// @returns the offset of the oldest byte still in the ring.
+		int64_t window_start() const;
+
+	private:
+		int fd;
+		settings opts;
+
+		// The byte at offset o of the stream is at ring[o % ring.size()].
+		std::vector<uint8_t> ring;
+		// the offset after the last byte read from the file descriptor
+		int64_t window_end = 0;
+		int64_t pos = 0;
+		bool eof = false;
+
+		statistics stats;
+	};
+}
@@ -0,0 +1,184 @@
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "probe_cache.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	// @returns true iff the cached stream can be restored into s, which the demuxer created from the header.
+	bool matches(const AVStream* s, const AVCodecParameters* cached, AVRational time_base)
+	{
+		if (s->codecpar->codec_type != cached->codec_type)
+		{
+			return false;
+		}
+		// The header may not tell the codec, but it must not tell another one.
+		if (s->codecpar->codec_id != AV_CODEC_ID_NONE && s->codecpar->codec_id != cached->codec_id)
+		{
+			return false;
+		}
+		return av_cmp_q(s->time_base, time_base) == 0;
+	}
+}
+
+ff::probe_cache& ff::probe_cache::instance()
+{
+	static probe_cache cache;
+	return cache;
+}
+
+std::list<ff::probe_cache::entry>::iterator ff::probe_cache::find(const std::string& fp, uint64_t size, int64_t mtime)
+{
+	return std::find_if(entries.begin(), entries.end(), [&](const entry& e)
+		{
+			return e.filepath == fp && e.file_size == size && e.file_mtime == mtime;
+		});
+}
+
+bool ff::probe_cache::restore(const std::string& fp, AVFormatContext* ctx)
+{
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	if (!ffhelpers::get_file_version(fp, size, mtime))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = find(fp, size, mtime);
+	if (it == entries.end())
+	{
+		return false;
+	}
+
+	const entry& e = *it;
+	// Streams that only appear while probing (e.g. of formats without a header) cannot be restored.
+	if (ctx->nb_streams != e.streams.size())
+	{
+		return false;
+	}
+	for (unsigned int i = 0; i != ctx->nb_streams; ++i)
+	{
+		if (!matches(ctx->streams[i], e.streams[i].codecpar.get(), e.streams[i].time_base))
+		{
+			return false;
+		}
+	}
+
+	for (unsigned int i = 0; i != ctx->nb_streams; ++i)
+	{
+		AVStream* s = ctx->streams[i];
+		const stream_info& info = e.streams[i];
+
+		if (avcodec_parameters_copy(s->codecpar, info.codecpar.get()) < 0)
+		{
+			// Fall back to probing, which fills the streams in anyway.
+			return false;
+		}
+		s->avg_frame_rate = info.avg_frame_rate;
+		s->r_frame_rate = info.r_frame_rate;
+		s->start_time = info.start_time;
+		s->duration = info.duration;
+		s->nb_frames = info.nb_frames;
+	}
+
+	ctx->start_time = e.start_time;
+	ctx->duration = e.duration;
+	ctx->bit_rate = e.bit_rate;
+
+	entries.splice(entries.begin(), entries, it);
+	return true;
+}
+
+void ff::probe_cache::store(const std::string& fp, const AVFormatContext* ctx)
+{
+	entry e;
+	e.filepath = fp;
+	if (!ffhelpers::get_file_version(fp, e.file_size, e.file_mtime))
+	{
+		return;
+	}
+
+	e.start_time = ctx->start_time;
+	e.duration = ctx->duration;
+	e.bit_rate = ctx->bit_rate;
+
+	e.streams.resize(ctx->nb_streams);
+	for (unsigned int i = 0; i != ctx->nb_streams; ++i)
+	{
+		const AVStream* s = ctx->streams[i];
+		stream_info& info = e.streams[i];
+
+		info.codecpar.reset(avcodec_parameters_alloc(), [](AVCodecParameters* p) { avcodec_parameters_free(&p); });
+		if (!info.codecpar)
+		{
+			ON_FF_ERROR("Could not allocate codec parameters to cache.")
+		}
+		int err = avcodec_parameters_copy(info.codecpar.get(), s->codecpar);
+		if (err < 0)
+		{
+			ON_FF_ERROR_WITH_CODE("Could not copy codec parameters to cache.", err)
+		}
+
+		info.time_base = s->time_base;
+		info.avg_frame_rate = s->avg_frame_rate;
+		info.r_frame_rate = s->r_frame_rate;
+		info.start_time = s->start_time;
+		info.duration = s->duration;
+		info.nb_frames = s->nb_frames;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Older versions of the file are of no use anymore.
+	entries.remove_if([&fp](const entry& old) { return old.filepath == fp; });
+
+	entries.push_front(std::move(e));
+	while (entries.size() > capacity)
+	{
+		entries.pop_back();
+	}
+}
+
+void ff::probe_cache::erase(const std::string& fp)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.remove_if([&fp](const entry& e) { return e.filepath == fp; });
+}
+
+void ff::probe_cache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+}
+
+size_t ff::probe_cache::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
+
+size_t ff::probe_cache::get_capacity() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return capacity;
+}
+
+void ff::probe_cache::set_capacity(size_t n)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	capacity = std::max<size_t>(n, 1);
+	while (entries.size() > capacity)
+	{
+		entries.pop_back();
+	}
+}
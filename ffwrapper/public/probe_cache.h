@@ -0,0 +1,104 @@
+/*
+* probe_cache.h:
+* Defines a process-wide cache of the stream information of the files opened, so that reopening them needs no probing.
+*/
+
+#pragma once
+
+#include "ff_time.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+
+struct AVFormatContext;
+struct AVCodecParameters;
+
+namespace ff
+{
+	/*
+	* Remembers what avformat_find_stream_info() found out about the streams of a file:
+	* their codec parameters, frame rates, start times and durations, and those of the container.
+	*
+	* Entries are keyed by the path, the size and the modification time of the file, so a file that changes is probed again.
+	* When the header of a reopened file gives the same streams, the entry is restored into them and probing is skipped.
+	*
+	* The cache is shared by the whole process. All methods are synchronized.
+	* When it's full, the least recently used entry is evicted.
+	*/
+	class probe_cache
+	{
+	public:
+		// @returns the cache of the process.
+		static probe_cache& instance();
+
+		probe_cache(const probe_cache&) = delete;
+		probe_cache& operator=(const probe_cache&) = delete;
+
+	public:
+		/*
+		* Fills the streams of ctx, just opened from the file at fp, with the information remembered about the file.
+		* @returns false if there is no valid entry for the file, or if the streams of ctx differ from those remembered.
+		 Then ctx is left untouched.
+		*/
+		bool restore(const std::string& fp, ::AVFormatContext* ctx);
+
+		/*
+		* Remembers the stream information of ctx, which is opened from the file at fp and probed.
+		* Does nothing if the version of the file cannot be read.
+		* @throws std::runtime_error if the codec parameters cannot be copied
+		*/
+		void store(const std::string& fp, const ::AVFormatContext* ctx);
+
+		// Forgets the file at fp.
+		void erase(const std::string& fp);
+		// Forgets everything.
+		void clear();
+
+		size_t size() const;
+		size_t get_capacity() const;
+		// Evicts entries at once if there are more than n. At least 1.
+		void set_capacity(size_t n);
+
+	private:
+		probe_cache() = default;
+
+		struct stream_info
+		{
+			std::shared_ptr<::AVCodecParameters> codecpar;
+			ff::time time_base{ 0, 1 };
+			ff::time avg_frame_rate{ 0, 1 };
+			ff::time r_frame_rate{ 0, 1 };
+			int64_t start_time = 0;
+			int64_t duration = 0;
+			int64_t nb_frames = 0;
+		};
+
+		struct entry
+		{
+			std::string filepath;
+			uint64_t file_size = 0;
+			int64_t file_mtime = 0;
+
+			// of the container
+			int64_t start_time = 0;
+			int64_t duration = 0;
+			int64_t bit_rate = 0;
+
+			std::vector<stream_info> streams;
+		};
+
+		// @returns the entry of the file of the version, or end(). Requires: the mutex is locked.
+		std::list<entry>::iterator find(const std::string& fp, uint64_t size, int64_t mtime);
+
+	private:
+		mutable std::mutex mutex;
+
+		// The front is the most recently used.
+		std::list<entry> entries;
+		size_t capacity = 256;
+	};
+}
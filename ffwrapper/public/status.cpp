@@ -0,0 +1,23 @@
+extern "C"
+{
+#include <libavutil/error.h>
+}
+
+#include "status.h"
+
+#include "../private/ff_helpers.h"
+
+bool ff::status::again() const
+{
+	return code == AVERROR(EAGAIN);
+}
+
+bool ff::status::eof() const
+{
+	return code == AVERROR_EOF;
+}
+
+std::string ff::status::message() const
+{
+	return ffhelpers::ff_translate_error_code(code);
+}
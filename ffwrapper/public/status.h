@@ -0,0 +1,44 @@
+/*
+* status.h:
+* Defines the result type of the non-throwing API.
+*/
+
+#pragma once
+
+#include <string>
+
+namespace ff
+{
+	/*
+	* The result of a noexcept operation. Carries the AVERROR code of the ffmpeg call behind it.
+	*
+	* EAGAIN and EOF are not errors: they tell the caller to feed/receive something else first, or that everything is out.
+	* Only is_error() means something went wrong.
+	*/
+	struct status
+	{
+	public:
+		constexpr status() : code(0) {}
+		constexpr explicit status(int c) : code(c) {}
+
+		static constexpr status success() { return status(0); }
+
+	public:
+		// @returns true iff the operation succeeded.
+		constexpr bool ok() const { return code >= 0; }
+		explicit constexpr operator bool() const { return ok(); }
+
+		// @returns true iff the operation could not be done now and should be retried after the other end is drained or fed.
+		bool again() const;
+		// @returns true iff the end of the stream is reached.
+		bool eof() const;
+		// @returns true iff the operation failed for a reason other than EAGAIN and EOF.
+		bool is_error() const { return !ok() && !again() && !eof(); }
+
+		// Translates the code into a string. Allocates, so only call it for errors that are to be reported.
+		std::string message() const;
+
+	public:
+		int code;
+	};
+}
@@ -0,0 +1,244 @@
+extern "C"
+{
+#include <libavutil/error.h>
+}
+
+#include "tail_input_io.h"
+#include "../private/ff_helpers.h"
+
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <cerrno>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+#endif
+
+ff::tail_input_io::tail_input_io(const std::string& fp) :
+	tail_input_io(fp, settings())
+{
+}
+
+ff::tail_input_io::tail_input_io(const std::string& fp, const settings& s) :
+	filepath(fp), opts(s)
+{
+	opts.poll_interval = std::max(opts.poll_interval, std::chrono::milliseconds(1));
+
+#if defined(_WIN32)
+	// The writer keeps the file open for writing, and may rename it when it's done.
+	file_handle = CreateFileW(std::filesystem::path(fp).wstring().c_str(), GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		ON_FF_ERROR("Could not open the file to follow.")
+	}
+#else
+	fd = open(std::filesystem::path(fp).string().c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		ON_FF_ERROR("Could not open the file to follow.")
+	}
+
+#if defined(__linux__)
+	// Polling the size is the fallback if there is no inotify, e.g. when the limit of instances is reached.
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd >= 0 && inotify_add_watch(inotify_fd, std::filesystem::path(fp).string().c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0)
+	{
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+#endif
+#endif
+}
+
+ff::tail_input_io::~tail_input_io()
+{
+#if defined(_WIN32)
+	if (file_handle)
+	{
+		CloseHandle(file_handle);
+	}
+#else
+	if (inotify_fd >= 0)
+	{
+		close(inotify_fd);
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+#endif
+}
+
+int64_t ff::tail_input_io::current_size() const
+{
+#if defined(_WIN32)
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file_handle, &size))
+	{
+		return AVERROR(EIO);
+	}
+	return size.QuadPart;
+#else
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		return AVERROR(errno);
+	}
+	return st.st_size;
+#endif
+}
+
+int64_t ff::tail_input_io::size() const
+{
+	if (!is_finished)
+	{
+		return AVERROR(ENOSYS);
+	}
+	return current_size();
+}
+
+int ff::tail_input_io::read(uint8_t* buf, int size)
+{
+	while (true)
+	{
+#if defined(_WIN32)
+		OVERLAPPED ov = {};
+		ov.Offset = (DWORD)(pos & 0xFFFFFFFF);
+		ov.OffsetHigh = (DWORD)(pos >> 32);
+		DWORD n = 0;
+		if (!ReadFile(file_handle, buf, (DWORD)size, &n, &ov) && GetLastError() != ERROR_HANDLE_EOF)
+		{
+			return AVERROR(EIO);
+		}
+#else
+		ssize_t n = pread(fd, buf, (size_t)size, (off_t)pos);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return AVERROR(errno);
+		}
+#endif
+		if (n > 0)
+		{
+			pos += n;
+			stats.num_bytes_read += n;
+			return (int)n;
+		}
+
+		// At the end of what is written so far.
+		if (is_finished || !wait_for_growth())
+		{
+			return AVERROR_EOF;
+		}
+	}
+}
+
+int64_t ff::tail_input_io::seek(int64_t offset, int whence)
+{
+	int64_t base = 0;
+	switch (whence)
+	{
+	case SEEK_SET:
+		base = 0;
+		break;
+	case SEEK_CUR:
+		base = pos;
+		break;
+	case SEEK_END:
+		base = current_size();
+		if (base < 0)
+		{
+			return base;
+		}
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	int64_t new_pos = base + offset;
+	if (new_pos < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+	// Beyond the end is fine. Reading there waits for the file to grow that far.
+	pos = new_pos;
+	return pos;
+}
+
+bool ff::tail_input_io::wait_for_growth()
+{
+	++stats.num_waits;
+	auto start = std::chrono::steady_clock::now();
+
+	bool grown = false;
+	while (true)
+	{
+		int64_t size = current_size();
+		if (size > pos)
+		{
+			grown = true;
+			break;
+		}
+
+		// Checked after the size, so that the bytes written before the end are read.
+		if (stop_requested || writer_closed ||
+			(opts.should_finish && opts.should_finish()) ||
+			(opts.idle_timeout.count() > 0 && std::chrono::steady_clock::now() - start >= opts.idle_timeout) ||
+			size < 0)
+		{
+			break;
+		}
+
+		wait_for_change();
+	}
+
+	stats.wait_time += std::chrono::steady_clock::now() - start;
+	if (!grown)
+	{
+		is_finished = true;
+	}
+	return grown;
+}
+
+void ff::tail_input_io::wait_for_change()
+{
+#if defined(__linux__)
+	if (inotify_fd >= 0)
+	{
+		pollfd pfd = { inotify_fd, POLLIN, 0 };
+		if (poll(&pfd, 1, (int)opts.poll_interval.count()) > 0)
+		{
+			alignas(inotify_event) char events[4096];
+			ssize_t len;
+			while ((len = ::read(inotify_fd, events, sizeof(events))) > 0)
+			{
+				for (char* p = events; p < events + len; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+				{
+					if ((((inotify_event*)p)->mask & IN_CLOSE_WRITE) && opts.finish_on_close_write)
+					{
+						writer_closed = true;
+					}
+				}
+			}
+		}
+		return;
+	}
+#endif
+	std::this_thread::sleep_for(opts.poll_interval);
+}
@@ -0,0 +1,135 @@
+/*
+* tail_input_io.h:
+* Defines an input_io that follows a file while another process is still writing it.
+*/
+
+#pragma once
+
+#include "input_io.h"
+
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <functional>
+
+namespace ff
+{
+	/*
+	* Reads a local file that is still growing, e.g. a recording the capture application has not finished yet.
+	*
+	* Reaching the end of the file does not end the stream. read() waits for the file to grow instead
+	 (inotify on Linux, polling elsewhere) and goes on with the new bytes, so the demuxer never sees AVERROR_EOF
+	 until one of the finish conditions below holds:
+	* - stop() is called, from any thread,
+	* - settings::should_finish returns true,
+	* - the writer closes the file, if settings::finish_on_close_write (Linux only),
+	* - the file has not grown for settings::idle_timeout.
+	* Whatever is already in the file is still read before it ends.
+	*
+	* The size of the file is reported as unknown until it's finished, so that ffmpeg does not estimate durations from it
+	 or look for indices at its end. Thus, the container must be readable front to back while it's written:
+	 MPEG-TS, MKV or fragmented MP4. A plain MP4 has its moov atom written last and cannot be followed.
+	*
+	* Opening the media waits for enough bytes to probe the format, so set input_options::probesize low
+	 if the recording has just started.
+	*/
+	class tail_input_io : public input_io
+	{
+	public:
+		struct settings
+		{
+			// Ends the stream if the file has not grown for this long. 0 to wait forever.
+			std::chrono::milliseconds idle_timeout{ 10000 };
+			// Ends the stream once the writer closes the file. Only supported with inotify.
+			bool finish_on_close_write = true;
+			// How often the finish conditions are checked while waiting.
+			std::chrono::milliseconds poll_interval{ 100 };
+			// Called while waiting. Returning true ends the stream. May be empty.
+			std::function<bool()> should_finish;
+		};
+
+		struct statistics
+		{
+			uint64_t num_bytes_read = 0;
+			// the number of times read() waited at the end of the file
+			uint64_t num_waits = 0;
+			// total time read() waited for the file to grow
+			std::chrono::nanoseconds wait_time{ 0 };
+		};
+
+	public:
+		tail_input_io() = delete;
+		/*
+		* Opens the file at fp, which may be empty for now.
+		* @throws std::runtime_error if the file cannot be opened
+		*/
+		tail_input_io(const std::string& fp, const settings& s);
+		// Uses the default settings.
+		explicit tail_input_io(const std::string& fp);
+
+		~tail_input_io() override;
+
+	public:
+		/*
+		* Reads at most size bytes, waiting for the file to grow at its end.
+		* @returns the number of bytes read, AVERROR_EOF once the file is finished and read through,
+		 or another negative AVERROR code on failure.
+		*/
+		int read(uint8_t* buf, int size) override;
+		// SEEK_END is relative to the current end of the file.
+		int64_t seek(int64_t offset, int whence) override;
+		// @returns the size of the file once it's finished, AVERROR(ENOSYS) while it may still grow.
+		int64_t size() const override;
+
+		std::string url() const override { return filepath; }
+
+	public:
+		/*
+		* Ends the stream at the current end of the file. Thread-safe.
+		* A read() waiting for the file to grow returns within settings::poll_interval.
+		*/
+		void stop() { stop_requested = true; }
+
+		// @returns true iff a finish condition held, so the file is not followed anymore. Thread-safe.
+		bool finished() const { return is_finished; }
+
+		const statistics& get_statistics() const { return stats; }
+
+	private:
+		// @returns the current size of the file, or a negative AVERROR code.
+		int64_t current_size() const;
+
+		/*
+		* Waits until the file is larger than pos.
+		* @returns true if it is, false if a finish condition holds first.
+		*/
+		bool wait_for_growth();
+
+		/*
+		* Waits for a change of the file for at most settings::poll_interval.
+		* Sets writer_closed if the writer closed it.
+		*/
+		void wait_for_change();
+
+	private:
+		std::string filepath;
+		settings opts;
+
+		int64_t pos = 0;
+
+#if defined(_WIN32)
+		void* file_handle = nullptr;
+#else
+		int fd = -1;
+		// the inotify instance watching the file. -1 if inotify is not available.
+		int inotify_fd = -1;
+#endif
+
+		std::atomic<bool> stop_requested{ false };
+		bool writer_closed = false;
+		std::atomic<bool> is_finished{ false };
+
+		statistics stats;
+	};
+}
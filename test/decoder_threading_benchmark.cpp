@@ -0,0 +1,129 @@
+/*
+* decoder_threading_benchmark.cpp: Defines decoder_threading_benchmark()
+*/
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include "../ffwrapper/public/media.h"
+#include "../ffwrapper/public/frame.h"
+#include "../ffwrapper/public/demuxer.h"
+#include "../ffwrapper/public/decoder.h"
+#include "../ffwrapper/public/packet_pool.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+/*
+* Decodes the best video stream of in_file with each of these threading settings in turn:
+* the default of libavcodec (no threading), slice and frame threading with 4 threads and with one per core,
+* low delay, automatic with and without low delay, and the shared codec_thread_pool.
+*
+* Prints the threads each decoder ended up with, the time each pass takes and its fps.
+* Slice threading only speeds up streams encoded with several slices per frame.
+*/
+void decoder_threading_benchmark(const char* in_file)
+{
+	try
+	{
+		auto run_pass = [&](const char* name, const ff::threading_options& threading) -> void
+		{
+			ff::input_media input(in_file);
+			if (!input.has_videos())
+			{
+				throw std::runtime_error("Input file does not contain any video streams.");
+			}
+			int vind = input.get_video_i(0);
+
+			ff::demuxer dem(input);
+			ff::packet_pool pool;
+			dem.set_packet_pool(&pool);
+
+			ff::decoder_options opts;
+			opts.threading = threading;
+			ff::input_decoder dec(dem.get_port(vind), opts);
+			dec.set_packet_pool(&pool);
+
+			ff::frame frame;
+			int64_t num_frames = 0;
+
+			auto start = std::chrono::steady_clock::now();
+
+			int port_num = -1;
+			while ((port_num = dem.demux_next_packet()) != -1)
+			{
+				ff::packet pkt(dem.get_port(port_num).try_get_one());
+				if (port_num != vind)
+				{
+					pool.release(pkt);
+					continue;
+				}
+
+				while (!dec.try_feed(pkt))
+				{
+					while (dec.try_get_one(frame))
+					{
+						++num_frames;
+					}
+				}
+				while (dec.try_get_one(frame))
+				{
+					++num_frames;
+				}
+			}
+			dec.start_draining();
+			while (dec.try_get_one(frame))
+			{
+				++num_frames;
+			}
+
+			auto end = std::chrono::steady_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+			ff::thread_type type = dec.get_active_thread_type();
+			std::cout << name << ": " << dec.get_thread_count() << " threads ("
+				<< (type == ff::thread_type::frame ? "frame" : type == ff::thread_type::slice ? "slice" : "none") << "), "
+				<< num_frames << " frames in " << ms << " ms ("
+				<< num_frames * 1000.0 / ms << " fps)" << std::endl;
+		};
+
+		auto manual = [](int count, ff::thread_type type, bool low_delay = false)
+		{
+			ff::threading_options t;
+			t.thread_count = count;
+			t.type = type;
+			t.low_delay = low_delay;
+			return t;
+		};
+		auto automatic = [](bool low_delay)
+		{
+			ff::threading_options t;
+			t.automatic = true;
+			t.low_delay = low_delay;
+			return t;
+		};
+
+		run_pass("default          ", ff::threading_options());
+		run_pass("slice x4         ", manual(4, ff::thread_type::slice));
+		run_pass("frame x4         ", manual(4, ff::thread_type::frame));
+		run_pass("slice per core   ", manual(0, ff::thread_type::slice));
+		run_pass("frame per core   ", manual(0, ff::thread_type::frame));
+		run_pass("low delay        ", manual(0, ff::thread_type::any, true));
+		run_pass("auto             ", automatic(false));
+		run_pass("auto, low delay  ", automatic(true));
+
+		ff::threading_options pooled;
+		pooled.shared_pool = true;
+		run_pass("shared pool      ", pooled);
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cout << std::string("ERROR: ") + e.what() << std::endl;
+	}
+}
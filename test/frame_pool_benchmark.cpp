@@ -0,0 +1,129 @@
+/*
+* frame_pool_benchmark.cpp: Defines frame_pool_benchmark()
+*/
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <chrono>
+#include "../ffwrapper/public/media.h"
+#include "../ffwrapper/public/frame.h"
+#include "../ffwrapper/public/demuxer.h"
+#include "../ffwrapper/public/decoder.h"
+#include "../ffwrapper/public/image_converter.h"
+#include "../ffwrapper/public/frame_pool.h"
+#include "../ffwrapper/private/utility/info.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+/*
+* Decodes the best video stream of in_file and converts every frame to RGBA, twice:
+* 1. with a new decoded frame and a new converted frame for each frame, like remux_per_frame did;
+* 2. with try_get_one(reuse) and a frame_pool.
+*
+* Prints the time each pass takes and the allocations made by the pool in pass 2.
+*/
+void frame_pool_benchmark(const char* in_file)
+{
+	try
+	{
+		ff::input_media input(in_file);
+		if (!input.has_videos())
+		{
+			throw std::runtime_error("Input file does not contain any video streams.");
+		}
+		int vind = input.get_video_i(0);
+
+		auto run_pass = [&](bool pooled) -> void
+		{
+			// rewind to the beginning, as the demuxer cannot seek to 0.
+			if (avformat_seek_file(input.get_format_ctx(), -1, INT64_MIN, 0, 0, 0) < 0)
+			{
+				throw std::runtime_error("Could not rewind the input.");
+			}
+
+			ff::demuxer dem(input);
+			ff::input_decoder dec(dem.get_port(vind));
+
+			ff::video_info src_info, dst_info;
+			dec.get_current_video_info(src_info);
+			dst_info = ff::video_info(AV_PIX_FMT_RGBA, src_info.width, src_info.height);
+
+			ff::image_converter converter
+			(
+				src_info.width, src_info.height, src_info.pix_fmt,
+				dst_info.width, dst_info.height, dst_info.pix_fmt,
+				SWS_POINT
+			);
+			ff::frame_pool pool(dst_info);
+			ff::frame frame;
+
+			int64_t num_frames = 0;
+
+			auto convert_all = [&]() -> void
+			{
+				while (pooled ? dec.try_get_one(frame) : (frame = dec.try_get_one()).is_valid())
+				{
+					if (pooled)
+					{
+						ff::frame dst_frame = pool.acquire();
+						converter.convert(frame, dst_frame);
+						pool.release(dst_frame);
+					}
+					else
+					{
+						ff::frame dst_frame;
+						dst_frame.create_video_buffer(dst_info.width, dst_info.height, dst_info.pix_fmt);
+						converter.convert(frame, dst_frame);
+					}
+					++num_frames;
+				}
+			};
+
+			auto start = std::chrono::steady_clock::now();
+
+			int port_num = -1;
+			while ((port_num = dem.demux_next_packet()) != -1)
+			{
+				ff::packet pkt(dem.get_port(port_num).try_get_one());
+				if (port_num != vind)
+				{
+					continue;
+				}
+
+				dec.try_feed(pkt);
+				convert_all();
+			}
+			dec.start_draining();
+			convert_all();
+
+			auto end = std::chrono::steady_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+			std::cout << (pooled ? "pooled:   " : "unpooled: ")
+				<< num_frames << " frames in " << ms << " ms ("
+				<< num_frames * 1000.0 / ms << " fps)" << std::endl;
+
+			if (pooled)
+			{
+				const auto& stats = pool.get_statistics();
+				std::cout << "  frame pool: " << stats.num_acquisitions << " acquisitions, "
+					<< stats.num_frame_allocations << " frame allocations, "
+					<< stats.num_buffer_allocations << " buffer allocations" << std::endl;
+			}
+		};
+
+		run_pass(false);
+		run_pass(true);
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cout << std::string("ERROR: ") + e.what() << std::endl;
+	}
+}
@@ -0,0 +1,80 @@
+/*
+* mmap_io_benchmark.cpp: Defines mmap_io_benchmark()
+*/
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include "../ffwrapper/public/media.h"
+#include "../ffwrapper/public/frame.h"
+#include "../ffwrapper/public/demuxer.h"
+#include "../ffwrapper/public/packet_pool.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+/*
+* Demuxes every packet of in_file with the file protocol of ffmpeg, a memory map, asynchronous reads
+* and a copy of the whole file in memory, twice each, in turn.
+* The memory passes include reading the file, and show the cost of demuxing without any I/O once it's cached.
+* The very first pass reads the file from the disk unless it's already cached. The second round compares
+* the cost of the I/O paths themselves. Use a file of several GB so that the difference is not lost
+* in the time to open it.
+*
+* Prints the time each pass takes and its throughput.
+*/
+void mmap_io_benchmark(const char* in_file)
+{
+	try
+	{
+		double file_mb = std::filesystem::file_size(in_file) / (1024.0 * 1024.0);
+
+		auto run_pass = [&](ff::file_io_backend backend) -> void
+		{
+			auto start = std::chrono::steady_clock::now();
+
+			ff::input_options opts;
+			opts.backend = backend;
+			ff::input_media input(in_file, opts);
+
+			ff::demuxer dem(input);
+			ff::packet_pool pool;
+			dem.set_packet_pool(&pool);
+
+			int64_t num_packets = 0;
+			int port_num = -1;
+			while ((port_num = dem.demux_next_packet()) != -1)
+			{
+				pool.release(dem.get_port(port_num).try_get_one());
+				++num_packets;
+			}
+
+			auto end = std::chrono::steady_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+			std::cout << (backend == ff::file_io_backend::mmap ? "mmap:     " :
+				backend == ff::file_io_backend::async ? "async:    " :
+				backend == ff::file_io_backend::memory ? "memory:   " : "protocol: ")
+				<< num_packets << " packets in " << ms << " ms ("
+				<< file_mb * 1000.0 / ms << " MB/s)" << std::endl;
+		};
+
+		for (int i = 0; i != 2; ++i)
+		{
+			run_pass(ff::file_io_backend::protocol);
+			run_pass(ff::file_io_backend::mmap);
+			run_pass(ff::file_io_backend::async);
+			run_pass(ff::file_io_backend::memory);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << std::string("ERROR: ") + e.what() << std::endl;
+	}
+}
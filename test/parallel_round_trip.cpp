@@ -0,0 +1,276 @@
+/*
+* parallel_round_trip.cpp: Defines parallel_round_trip()
+*/
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include <memory>
+#include "../ffwrapper/public/media.h"
+#include "../ffwrapper/public/frame.h"
+#include "../ffwrapper/public/demuxer.h"
+#include "../ffwrapper/public/muxer.h"
+#include "../ffwrapper/public/decoder.h"
+#include "../ffwrapper/public/frame_server.h"
+#include "../ffwrapper/public/gop_parallel_decoder.h"
+#include "../ffwrapper/public/chunked_encoder.h"
+#include "../ffwrapper/public/image_converter.h"
+#include "../ffwrapper/public/frame_pool.h"
+#include "../ffwrapper/public/format_negotiation.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+namespace
+{
+	// The time a frame is shown at.
+	int64_t shown_at(const ff::frame& f)
+	{
+		return f->pts != AV_NOPTS_VALUE ? f->pts : f->best_effort_timestamp;
+	}
+
+	// FNV-1a over the visible bytes of the first plane, which tells two decodes of the same frame apart from different frames.
+	uint64_t checksum(const ff::frame& f)
+	{
+		int row = av_image_get_linesize((AVPixelFormat)f->format, f->width, 0);
+		uint64_t h = 14695981039346656037ull;
+		for (int y = 0; y < f->height; ++y)
+		{
+			const uint8_t* p = f->data[0] + (ptrdiff_t)y * f->linesize[0];
+			for (int x = 0; x < row; ++x)
+			{
+				h = (h ^ p[x]) * 1099511628211ull;
+			}
+		}
+		return h;
+	}
+
+	// Decodes every frame of stream vind one at a time, which the parallel engines are checked against.
+	std::vector<std::pair<int64_t, uint64_t>> decode_sequentially(ff::demuxer& dem, ff::input_decoder& dec, int vind)
+	{
+		std::vector<std::pair<int64_t, uint64_t>> ret;
+		ff::frame frame;
+
+		auto take_frames = [&]()
+		{
+			while (dec.try_get_one(frame))
+			{
+				ret.emplace_back(shown_at(frame), checksum(frame));
+			}
+		};
+
+		int port_num = -1;
+		while ((port_num = dem.demux_next_packet()) != -1)
+		{
+			ff::packet pkt(dem.get_port(port_num).try_get_one());
+			if (port_num != vind)
+			{
+				continue;
+			}
+
+			while (!dec.try_feed(pkt))
+			{
+				take_frames();
+			}
+			take_frames();
+		}
+		dec.start_draining();
+		take_frames();
+
+		return ret;
+	}
+}
+
+/*
+* Checks the multithreaded engines against a plain decode of the best video stream of in_file:
+* 1. gop_parallel_decoder must output the same frames, in the same order.
+* 2. frame_server must serve the same frame at each time, asked for backwards and out of order.
+* 3. chunked_encoder re-encodes the frames of a gop_parallel_decoder into out_file, which must decode to as many frames,
+ with every dts after the one before and at or before its pts.
+*
+* Prints the mismatches and the statistics of each engine.
+*/
+void parallel_round_trip(const char* in_file, const char* out_file)
+{
+	try
+	{
+		ff::input_media input(in_file);
+		if (!input.has_videos())
+		{
+			throw std::runtime_error("Input file does not contain any video streams.");
+		}
+		int vind = input.get_video_i(0);
+		ff::time in_time_base = input.get_stream(vind).get_time_base();
+
+		// The reference. The decoder is kept for the chunk encoders, which take its parameters.
+		ff::demuxer dem(input);
+		ff::input_decoder ref_dec(dem.get_port(vind));
+		auto reference = decode_sequentially(dem, ref_dec, vind);
+		std::cout << "reference: " << reference.size() << " frames" << std::endl;
+
+		// 1. gop_parallel_decoder
+		{
+			ff::gop_parallel_decoder gop_dec(in_file, vind);
+
+			size_t n = 0, mismatches = 0;
+			ff::frame f(nullptr);
+			while ((f = gop_dec.wait_and_get_one()).is_valid())
+			{
+				if (n >= reference.size() || reference[n] != std::make_pair(shown_at(f), checksum(f)))
+				{
+					++mismatches;
+				}
+				++n;
+			}
+
+			auto stats = gop_dec.get_statistics();
+			std::cout << "gop_parallel_decoder: " << n << " frames, " << mismatches << " mismatches, "
+				<< stats.num_ranges << " ranges, " << stats.num_dropped_frames << " dropped leading frames" << std::endl;
+		}
+
+		// 2. frame_server
+		{
+			ff::input_media m(in_file);
+			ff::frame_server server(m, vind);
+
+			// Backwards, then strided forwards, so that both seeking back and going on are exercised.
+			std::vector<size_t> order;
+			for (size_t k = reference.size(); k > 0; k = k > 5 ? k - 5 : 0)
+			{
+				order.push_back(k - 1);
+			}
+			for (size_t k = 0; k < reference.size(); k += 7)
+			{
+				order.push_back(k);
+			}
+
+			size_t mismatches = 0;
+			for (size_t k : order)
+			{
+				ff::frame f = server.get_frame_at(reference[k].first);
+				if (!f.is_valid() || checksum(f) != reference[k].second)
+				{
+					++mismatches;
+				}
+			}
+			std::cout << "frame_server: " << order.size() << " frames asked, " << mismatches << " mismatches" << std::endl;
+		}
+
+		// 3. chunked_encoder
+		{
+			ff::output_media output(out_file);
+			ff::muxer mux(output);
+
+			ff::chunked_encoder enc(ref_dec, output, output.get_codec_id(AVMEDIA_TYPE_VIDEO));
+			const ff::encoder& stream_enc = enc.get_stream_encoder();
+			ff::time enc_time_base = stream_enc.get_codec_ctx()->time_base;
+
+			ff::pixel_format_path path = ff::get_pixel_format_path(ref_dec, stream_enc);
+			std::cout << "chunked_encoder: " << path.to_string() << std::endl;
+			std::unique_ptr<ff::image_converter> converter;
+			std::unique_ptr<ff::frame_pool> converted;
+			if (path.needs_conversion())
+			{
+				converter.reset(new ff::image_converter
+				(
+					path.decoded.width, path.decoded.height, path.decoded.pix_fmt,
+					path.encoded.width, path.encoded.height, path.encoded.pix_fmt,
+					SWS_BILINEAR
+				));
+				converted.reset(new ff::frame_pool(path.encoded));
+			}
+
+			ff::output_stream ostream = output.add_stream(stream_enc);
+			mux.write_file_header();
+			ff::time out_time_base = output.get_stream(0).get_time_base();
+
+			int64_t num_packets = 0, last_dts = AV_NOPTS_VALUE, bad_dts = 0;
+			auto write_packet = [&](ff::packet& pkt)
+			{
+				if (pkt->dts != AV_NOPTS_VALUE)
+				{
+					if ((last_dts != AV_NOPTS_VALUE && pkt->dts <= last_dts) || (pkt->pts != AV_NOPTS_VALUE && pkt->dts > pkt->pts))
+					{
+						++bad_dts;
+					}
+					last_dts = pkt->dts;
+				}
+
+				pkt.rescale_time(enc_time_base, out_time_base);
+				pkt->stream_index = ostream->index;
+				pkt->pos = -1;
+				ff::status res = mux.feed(pkt);
+				if (res.is_error())
+				{
+					throw std::runtime_error(std::string("Could not feed a packet to the output file. ") + res.message());
+				}
+				++num_packets;
+			};
+
+			ff::gop_parallel_decoder gop_dec(in_file, vind);
+			int64_t num_fed = 0;
+			ff::frame f(nullptr);
+			while ((f = gop_dec.wait_and_get_one()).is_valid())
+			{
+				int64_t pts = av_rescale_q(shown_at(f), in_time_base, enc_time_base);
+				if (converter)
+				{
+					ff::frame dst_frame = converted->acquire();
+					converter->convert(f, dst_frame);
+					// The chunks are cut at the keyframes of the source.
+					av_frame_copy_props(dst_frame, f);
+					f = std::move(dst_frame);
+				}
+				f->pts = pts;
+
+				enc.try_feed(f);
+				++num_fed;
+
+				ff::packet pkt(nullptr);
+				while ((pkt = enc.try_get_one()).is_valid())
+				{
+					write_packet(pkt);
+				}
+			}
+
+			enc.start_draining();
+			ff::packet pkt(nullptr);
+			while ((pkt = enc.wait_and_get_one()).is_valid())
+			{
+				write_packet(pkt);
+			}
+			mux.finalize();
+
+			auto stats = enc.get_statistics();
+			std::cout << "chunked_encoder: " << num_fed << " frames in " << stats.num_chunks << " chunks, "
+				<< num_packets << " packets, " << stats.num_dts_fixes << " shifted dts, " << bad_dts << " bad dts, "
+				<< std::chrono::duration<double, std::milli>(stats.feed_wait_time).count() << " ms waiting for the workers" << std::endl;
+		}
+
+		// The round trip
+		{
+			ff::input_media encoded(out_file);
+			int ovind = encoded.get_video_i(0);
+			ff::demuxer odem(encoded);
+			ff::input_decoder odec(odem.get_port(ovind));
+			auto decoded = decode_sequentially(odem, odec, ovind);
+
+			std::cout << "round trip: " << reference.size() << " frames in, " << decoded.size() << " frames out"
+				<< (decoded.size() == reference.size() ? "" : " MISMATCH") << std::endl;
+		}
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cout << std::string("ERROR: ") + e.what() << std::endl;
+	}
+}
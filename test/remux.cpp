@@ -10,6 +10,7 @@
 #include "../ffwrapper/public/frame.h"
 #include "../ffwrapper/public/demuxer.h"
 #include "../ffwrapper/public/muxer.h"
+#include "../ffwrapper/public/packet_pool.h"
 
 extern "C"
 {
@@ -36,6 +37,12 @@ void remux(const char* in_file, const char* out_file, double start_time = 0.0)
 		ff::output_media output(out_file);
 		ff::muxer mux(output);
 
+		// Packets fed to the muxer go back to the demuxer through the pool,
+		// so that after a few packets no more are allocated.
+		ff::packet_pool pkt_pool;
+		dem.set_packet_pool(&pkt_pool);
+		mux.set_packet_pool(&pkt_pool);
+
 		// select the key stream in this way:
 		// if the media has video streams, then it's the key video stream.
 		// otherwise, if the media has audio streams, then it's the key audio stream.
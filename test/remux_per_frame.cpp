@@ -15,6 +15,8 @@
 #include "../ffwrapper/public/image_converter.h"
 #include "../ffwrapper/public/audio_resampler.h"
 #include "../ffwrapper/public/packet_retimer.h"
+#include "../ffwrapper/public/frame_pool.h"
+#include "../ffwrapper/public/format_negotiation.h"
 #include "../ffwrapper/private/utility/info.h"
 
 extern "C"
@@ -43,7 +45,14 @@ void remux_per_frame(const char* in_file, const char* out_file, double start_tim
 
 		for (int i = 0; i != input.num_streams(); ++i)
 		{
-			decoders.push_back(new ff::input_decoder(dem.get_port(i)));
+			// Negotiate the pixel formats: the decoder prefers what the encoder takes,
+			// and the encoder takes what the decoder outputs if it can.
+			ff::decoder_options dec_opts;
+			if (input.get_stream(i).is_video())
+			{
+				dec_opts.preferred_pixel_formats = ff::get_encoder_pixel_formats(input.get_stream(i)->codecpar->codec_id);
+			}
+			decoders.push_back(new ff::input_decoder(dem.get_port(i), dec_opts));
 			encoders.push_back(new ff::direct_encoder(*decoders[i], output, input.get_stream(i)));
 		}
 
@@ -53,6 +62,9 @@ void remux_per_frame(const char* in_file, const char* out_file, double start_tim
 		// After initialization, at each slot, the pointer will be
 		// nullptr if the converter is not needed, or the converter initialized.
 		std::vector<void*> converters;
+		// Converted images are taken from these pools so that they are not allocated for each frame.
+		// nullptr if the stream does not convert images.
+		std::vector<ff::frame_pool*> frame_pools;
 		// same for packet retimers
 		std::vector<ff::packet_retimer*> pkt_retimers;
 
@@ -65,15 +77,23 @@ void remux_per_frame(const char* in_file, const char* out_file, double start_tim
 			// image converters
 			if (input.get_stream(i).is_video())
 			{
-				ff::video_info src_info, dst_info;
-				decoders[i]->get_current_video_info(src_info); encoders[i]->get_current_video_info(dst_info);
-				if (src_info == dst_info)
+				ff::pixel_format_path path = ff::get_pixel_format_path(*decoders[i], *encoders[i]);
+				std::cout << "stream " << i << ": " << path.to_string() << std::endl;
+
+				if (!path.needs_conversion())
 				{
 					converters.push_back(nullptr);
+					frame_pools.push_back(nullptr);
 				}
 				else
 				{
-					converters.push_back((void*)new ff::image_converter(*decoders[i], *encoders[i], SWS_BILINEAR));
+					converters.push_back((void*)new ff::image_converter
+					(
+						path.decoded.width, path.decoded.height, path.decoded.pix_fmt,
+						path.encoded.width, path.encoded.height, path.encoded.pix_fmt,
+						SWS_BILINEAR
+					));
+					frame_pools.push_back(new ff::frame_pool(path.encoded));
 				}
 			}
 			// audio resamplers
@@ -89,6 +109,7 @@ void remux_per_frame(const char* in_file, const char* out_file, double start_tim
 				{
 					converters.push_back((void*)new ff::audio_resampler(*decoders[i], *encoders[i]));
 				}
+				frame_pools.push_back(nullptr);
 			}
 
 		}
@@ -152,6 +173,21 @@ void remux_per_frame(const char* in_file, const char* out_file, double start_tim
 			));
 		}
 
+		// Decoded frames go here.
+		ff::frame frame;
+		// Encoded packets go here.
+		ff::packet out_pkt;
+
+		// The loop below uses the non-throwing API, so that running out of input/output (EAGAIN/EOF)
+		// costs nothing. Only real errors end up here.
+		auto throw_if_error = [](ff::status res, const char* msg) -> void
+		{
+			if (res.is_error())
+			{
+				throw std::runtime_error(std::string(msg) + " " + res.message());
+			}
+		};
+
 		// Feed packets to muxer
 		// Use do-while because first the packet from seek should be fed.
 		do
@@ -166,11 +202,12 @@ void remux_per_frame(const char* in_file, const char* out_file, double start_tim
 				auto* dec = decoders[port_num]; 
 				auto* enc = encoders[port_num];
 
-				dec->try_feed(pkt);
+				throw_if_error(dec->feed(pkt), "Could not feed a packet to the decoder.");
 				pkt.unref();
 
-				ff::frame frame;
-				while ((frame = dec->try_get_one()).is_valid())
+				// The frame is reused for every decoded frame.
+				ff::status res;
+				while ((res = dec->receive(frame)).ok())
 				{
 					// seeking will give us frames of time before the time we want. Just discard them.
 					double st = ff::time_in_base_to_seconds(frame->pts, input.get_stream(port_num).get_time_base());
@@ -183,29 +220,36 @@ void remux_per_frame(const char* in_file, const char* out_file, double start_tim
 
 					if (converters[port_num] != nullptr)
 					{
-						ff::frame dst_frame;
-
 						if (ostream.is_video())
 						{
+							ff::frame dst_frame = frame_pools[port_num]->acquire();
+							dst_frame->pts = frame->pts;
+
 							auto* img_converter = (ff::image_converter*)converters[port_num];
 							img_converter->convert(frame, dst_frame);
+							throw_if_error(enc->feed(dst_frame), "Could not feed a frame to the encoder.");
+
+							// The encoder holds its own reference to the planes. Return the shell.
+							frame_pools[port_num]->release(dst_frame);
 						}
 						else if (ostream.is_audio())
 						{
+							ff::frame dst_frame;
+
 							auto* aud_resampler = (ff::audio_resampler*)converters[port_num];
 							aud_resampler->convert(frame, dst_frame);
+							throw_if_error(enc->feed(dst_frame), "Could not feed a frame to the encoder.");
 						}
-						enc->try_feed(dst_frame);
 					}
 					else
 					{
-						enc->try_feed(frame);
+						throw_if_error(enc->feed(frame), "Could not feed a frame to the encoder.");
 					}
 					// Don't forget this
 					frame.unref();
 
-					ff::packet out_pkt;
-					while ((out_pkt = enc->try_get_one()).is_valid())
+					ff::status enc_res;
+					while ((enc_res = enc->receive(out_pkt)).ok())
 					{
 						out_pkt->stream_index = ostream->index;
 						out_pkt->pos = -1;
@@ -216,9 +260,12 @@ void remux_per_frame(const char* in_file, const char* out_file, double start_tim
 							pkt_retimers[port_num]->retime(out_pkt);
 							out_pkt->time_base = output.get_stream(port_num).get_time_base();
 						}
-						mux.try_feed(out_pkt);
+						// The muxer takes the data and leaves out_pkt clean for the next one.
+						throw_if_error(mux.feed(out_pkt), "Could not feed a packet to the output file.");
 					}
+					throw_if_error(enc_res, "Could not encode a packet.");
 				}
+				throw_if_error(res, "Could not decode a frame.");
 			}
 		} while ((port_num = dem.demux_next_packet()) != -1);
 
@@ -25,9 +25,14 @@ extern "C"
 constexpr auto input_file_name = "D:\\GameRec\\Doom Eternal\\lv1.mp4";
 constexpr auto remux_output_file_name = "remux_output.mp4";
 constexpr auto remux_per_frame_output_file_name = "remux_per_frame_output.mp4";
+constexpr auto parallel_round_trip_output_file_name = "parallel_round_trip_output.mp4";
 
 void remux(const char* in_file, const char* out_file, double start_time);
 void remux_per_frame(const char* in_file, const char* out_file, double start_time);
+void frame_pool_benchmark(const char* in_file);
+void mmap_io_benchmark(const char* in_file);
+void decoder_threading_benchmark(const char* in_file);
+void parallel_round_trip(const char* in_file, const char* out_file);
 
 int main()
 {
@@ -194,6 +199,10 @@ int main()
 
 	//remux(input_file_name, remux_output_file_name, 1200.0);
 	remux_per_frame(input_file_name, remux_per_frame_output_file_name, 1200.0);
+	//frame_pool_benchmark(input_file_name);
+	//mmap_io_benchmark(input_file_name);
+	//decoder_threading_benchmark(input_file_name);
+	//parallel_round_trip(input_file_name, parallel_round_trip_output_file_name);
 
     return 0;
 }